@@ -0,0 +1,77 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+#include <limits>
+#include "ray.h"
+
+struct Aabb
+{
+    float min[3];
+    float max[3];
+
+    Aabb()
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            min[i] = std::numeric_limits<float>::max();
+            max[i] = -std::numeric_limits<float>::max();
+        }
+    }
+
+    bool empty() const { return min[0] > max[0]; }
+
+    void expand(const float point[3])
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            min[i] = std::min(min[i], point[i]);
+            max[i] = std::max(max[i], point[i]);
+        }
+    }
+
+    void expand(const Aabb &other)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            min[i] = std::min(min[i], other.min[i]);
+            max[i] = std::max(max[i], other.max[i]);
+        }
+    }
+
+    float centroid(int axis) const { return 0.5f * (min[axis] + max[axis]); }
+
+    float surfaceArea() const
+    {
+        if (empty())
+        {
+            return 0.0f;
+        }
+        float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // Slab test against the ray's (t_min, t_max) interval. Returns the entry
+    // distance in t_entry when the box overlaps it.
+    bool intersect(const Ray &ray, float &t_entry) const
+    {
+        const float *planes[2] = {min, max};
+        float t_near = ray.t_min;
+        float t_far = ray.t_max;
+        for (int i = 0; i < 3; ++i)
+        {
+            float t0 = (planes[ray.sign[i]][i] - ray.origin[i]) * ray.inv_direction[i];
+            float t1 = (planes[1 - ray.sign[i]][i] - ray.origin[i]) * ray.inv_direction[i];
+            t_near = t0 > t_near ? t0 : t_near;
+            t_far = t1 < t_far ? t1 : t_far;
+            if (t_near > t_far)
+            {
+                return false;
+            }
+        }
+        t_entry = t_near;
+        return true;
+    }
+};
+
+#endif
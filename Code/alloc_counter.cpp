@@ -0,0 +1,95 @@
+#include "alloc_counter.h"
+#include <cstdlib>
+#include <new>
+
+// Constant-initialized, so counting is safe even for allocations made before
+// main or during thread start-up.
+static thread_local uint64_t heap_allocations = 0;
+
+uint64_t threadHeapAllocations()
+{
+    return heap_allocations;
+}
+
+static void *countedAllocate(std::size_t size)
+{
+    ++heap_allocations;
+    return std::malloc(size ? size : 1);
+}
+
+static void *countedAllocate(std::size_t size, std::align_val_t alignment)
+{
+    ++heap_allocations;
+    std::size_t align = static_cast<std::size_t>(alignment);
+    if (align < sizeof(void *))
+    {
+        align = sizeof(void *);
+    }
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, align, size ? size : 1) != 0)
+    {
+        return nullptr;
+    }
+    return pointer;
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *pointer = countedAllocate(size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *pointer = countedAllocate(size, alignment))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
@@ -0,0 +1,12 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Number of global operator new calls made by the calling thread. Linking
+// alloc_counter.cpp replaces the global allocation functions with counting
+// versions that forward to malloc; differences of this value bracket a piece
+// of code to check it does not allocate.
+uint64_t threadHeapAllocations();
+
+#endif
@@ -0,0 +1,91 @@
+#include "animation.h"
+#include "instance.h"
+#include <algorithm>
+
+// Finds the keyframes around frame and the blend weight between them.
+template <typename Keyframe>
+static void findSegment(const std::vector<Keyframe> &keyframes, float frame, size_t &first, size_t &second, float &alpha)
+{
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+                                 [](float value, const Keyframe &key) { return value < key.frame; });
+    if (next == keyframes.begin())
+    {
+        first = second = 0;
+        alpha = 0.0f;
+        return;
+    }
+    if (next == keyframes.end())
+    {
+        first = second = keyframes.size() - 1;
+        alpha = 0.0f;
+        return;
+    }
+    second = static_cast<size_t>(next - keyframes.begin());
+    first = second - 1;
+    alpha = (frame - keyframes[first].frame) / (keyframes[second].frame - keyframes[first].frame);
+}
+
+static float lerp(float a, float b, float alpha)
+{
+    return a + (b - a) * alpha;
+}
+
+void Animation::cameraAt(float frame, std::vector<float> &position, std::vector<float> &look_at, float &fov) const
+{
+    if (camera.empty())
+    {
+        return;
+    }
+    size_t first, second;
+    float alpha;
+    findSegment(camera, frame, first, second, alpha);
+    const CameraKeyframe &a = camera[first];
+    const CameraKeyframe &b = camera[second];
+    for (int i = 0; i < 3; ++i)
+    {
+        position[i] = lerp(a.position[i], b.position[i], alpha);
+        look_at[i] = lerp(a.look_at[i], b.look_at[i], alpha);
+    }
+    fov = lerp(a.fov, b.fov, alpha);
+}
+
+void Animation::transformAt(const InstanceTrack &track, float frame, float transform[12])
+{
+    size_t first, second;
+    float alpha;
+    findSegment(track.keyframes, frame, first, second, alpha);
+    const TransformKeyframe &a = track.keyframes[first];
+    const TransformKeyframe &b = track.keyframes[second];
+    float translate[3], rotate[3], scale[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        translate[i] = lerp(a.translate[i], b.translate[i], alpha);
+        rotate[i] = lerp(a.rotate[i], b.rotate[i], alpha);
+        scale[i] = lerp(a.scale[i], b.scale[i], alpha);
+    }
+    composeTransform(translate, rotate, scale, transform);
+}
+
+std::string Animation::frameFilename(const std::string &pattern, int frame)
+{
+    std::string number = std::to_string(frame);
+    size_t start = pattern.find('#');
+    if (start == std::string::npos)
+    {
+        number = std::string(number.size() < 4 ? 4 - number.size() : 0, '0') + number;
+        size_t dot = pattern.find_last_of('.');
+        size_t slash = pattern.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        {
+            return pattern + "_" + number;
+        }
+        return pattern.substr(0, dot) + "_" + number + pattern.substr(dot);
+    }
+    size_t end = pattern.find_first_not_of('#', start);
+    size_t width = (end == std::string::npos ? pattern.size() : end) - start;
+    if (number.size() < width)
+    {
+        number = std::string(width - number.size(), '0') + number;
+    }
+    return pattern.substr(0, start) + number + (end == std::string::npos ? "" : pattern.substr(end));
+}
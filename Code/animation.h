@@ -0,0 +1,53 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <string>
+#include <vector>
+
+struct CameraKeyframe
+{
+    float frame;
+    std::vector<float> position;
+    std::vector<float> look_at;
+    float fov;
+};
+
+// Translate, rotate (degrees about x, y, z) and scale, composed as in the
+// scene file's instance placement.
+struct TransformKeyframe
+{
+    float frame = 0.0f;
+    float translate[3] = {0.0f, 0.0f, 0.0f};
+    float rotate[3] = {0.0f, 0.0f, 0.0f};
+    float scale[3] = {1.0f, 1.0f, 1.0f};
+};
+
+struct InstanceTrack
+{
+    int instance;
+    std::vector<TransformKeyframe> keyframes;
+};
+
+// Keyframed camera and instance motion for rendering a frame range in one
+// process. Keyframes are sorted by frame; values are interpolated linearly
+// between neighbours and held before the first and after the last keyframe.
+class Animation
+{
+public:
+    bool empty() const { return last_frame < first_frame; }
+    void cameraAt(float frame, std::vector<float> &position, std::vector<float> &look_at, float &fov) const;
+    static void transformAt(const InstanceTrack &track, float frame, float transform[12]);
+
+    // Replaces the first run of '#' in pattern with the zero-padded frame
+    // number, or appends "_NNNN" before the extension when there is none.
+    static std::string frameFilename(const std::string &pattern, int frame);
+
+    int first_frame = 0;
+    int last_frame = -1;
+    std::string output = "frame_####.ppm";
+    float rebuild_threshold = 2.0f;
+    std::vector<CameraKeyframe> camera;
+    std::vector<InstanceTrack> instances;
+};
+
+#endif
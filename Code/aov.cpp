@@ -0,0 +1,82 @@
+#include "aov.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "scene.h"
+
+AovSample AovSample::fromHit(const Scene &scene, const HitRecord &hit, const Vec3 &normal, const Material &material)
+{
+    AovSample sample;
+    sample.depth = hit.t;
+    sample.normal = normal;
+    // Mirrors and glass show whatever they reflect or refract; a denoiser
+    // wants white for them rather than their unused diffuse color.
+    bool phong = material.kernel == ShadingKernel::Diffuse || material.kernel == ShadingKernel::Specular || material.kernel == ShadingKernel::Glossy;
+    sample.albedo = phong ? Vec3{material.diffuse_color[0], material.diffuse_color[1], material.diffuse_color[2]} : Vec3{1.0f, 1.0f, 1.0f};
+    sample.ids = {static_cast<float>(scene.primitiveId(hit) + 1), static_cast<float>(hit.instance + 1), static_cast<float>(material.id + 1)};
+    return sample;
+}
+
+AovBuffers::AovBuffers(int width, int height)
+    : width(width), height(height), pixels(static_cast<size_t>(width) * height)
+{
+}
+
+AovSample AovBuffers::resolve(const AovSample *samples, int count)
+{
+    AovSample pixel = samples[0];
+    if (count == 1)
+    {
+        return pixel;
+    }
+    for (int sample = 1; sample < count; ++sample)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            pixel.normal[c] += samples[sample].normal[c];
+            pixel.albedo[c] += samples[sample].albedo[c];
+        }
+    }
+    float inverse = 1.0f / count;
+    for (int c = 0; c < 3; ++c)
+    {
+        pixel.normal[c] *= inverse;
+        pixel.albedo[c] *= inverse;
+    }
+    return pixel;
+}
+
+void AovBuffers::write(const std::string &prefix) const
+{
+    writePFM(prefix + "_depth.pfm", 1, [](const AovSample &pixel) { return &pixel.depth; });
+    writePFM(prefix + "_normal.pfm", 3, [](const AovSample &pixel) { return pixel.normal.data(); });
+    writePFM(prefix + "_albedo.pfm", 3, [](const AovSample &pixel) { return pixel.albedo.data(); });
+    writePFM(prefix + "_id.pfm", 3, [](const AovSample &pixel) { return pixel.ids.data(); });
+}
+
+template <typename Channel>
+bool AovBuffers::writePFM(const std::string &filename, int channels, Channel &&channel) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
+        return false;
+    }
+    // The sign of the scale line gives the byte order: negative is little endian.
+    uint16_t probe = 1;
+    unsigned char first_byte;
+    std::memcpy(&first_byte, &probe, 1);
+    file << (channels == 1 ? "Pf" : "PF") << "\n" << width << " " << height << "\n" << (first_byte ? "-1.0" : "1.0") << "\n";
+    std::vector<float> row(static_cast<size_t>(width) * channels);
+    for (int y = height - 1; y >= 0; --y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            std::memcpy(&row[static_cast<size_t>(x) * channels], channel(pixels[static_cast<size_t>(y) * width + x]), channels * sizeof(float));
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,58 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include <limits>
+#include <string>
+#include <vector>
+#include "hit_record.h"
+#include "material.h"
+#include "vector_utils.h"
+
+class Scene;
+
+// What a camera ray's first hit leaves in the auxiliary outputs. The defaults
+// are a miss: infinite depth and zero everywhere else.
+struct AovSample
+{
+    // Distance along the (unit length) camera ray.
+    float depth = std::numeric_limits<float>::infinity();
+    Vec3 normal = {0.0f, 0.0f, 0.0f};
+    Vec3 albedo = {0.0f, 0.0f, 0.0f};
+    // Primitive (numbered within its geometry group), instance and material,
+    // each plus one, so 0 means none; shapes placed directly in the scene have
+    // instance 0. Stored as floats, so exact up to 2^24.
+    Vec3 ids = {0.0f, 0.0f, 0.0f};
+
+    static AovSample fromHit(const Scene &scene, const HitRecord &hit, const Vec3 &normal, const Material &material);
+};
+
+// Full-frame float buffers filled alongside the color image by the primary
+// ray pass, for denoisers and compositing. Pixels are kept interleaved, so
+// rendering a tile row writes one contiguous run, and are split into images
+// when written.
+class AovBuffers
+{
+public:
+    AovBuffers(int width, int height);
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // Normal and albedo are averaged over a pixel's samples; depth and ids,
+    // which do not blend, come from its first.
+    static AovSample resolve(const AovSample *samples, int count);
+    void setPixel(int x, int y, const AovSample &pixel) { pixels[static_cast<size_t>(y) * width + x] = pixel; }
+    // Writes prefix_depth.pfm, prefix_normal.pfm, prefix_albedo.pfm and
+    // prefix_id.pfm. Failures are reported on stderr.
+    void write(const std::string &prefix) const;
+
+private:
+    // Portable float map: "Pf" for one channel, "PF" for three, rows bottom to
+    // top. channel picks channels floats from each pixel.
+    template <typename Channel>
+    bool writePFM(const std::string &filename, int channels, Channel &&channel) const;
+
+    int width;
+    int height;
+    std::vector<AovSample> pixels;
+};
+
+#endif
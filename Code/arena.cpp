@@ -0,0 +1,118 @@
+#include "arena.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+struct Arena::Block
+{
+    Block *next;
+    size_t size;
+
+    unsigned char *data() { return reinterpret_cast<unsigned char *>(this + 1); }
+};
+
+static std::atomic<uint64_t> block_allocations{0};
+
+Arena::~Arena()
+{
+    freeBlocks();
+}
+
+Arena &Arena::local()
+{
+    static thread_local Arena arena;
+    return arena;
+}
+
+uint64_t Arena::blockAllocations()
+{
+    return block_allocations.load(std::memory_order_relaxed);
+}
+
+// Blocks grow geometrically: a new block is at least as large as all the
+// earlier ones together, so an arena needs only a handful of blocks whatever
+// the size of its allocations.
+void *Arena::allocate(size_t bytes, size_t alignment)
+{
+    // Try the current block, then any later blocks kept from earlier use,
+    // before growing. A block that is too small is skipped, not split.
+    if (!current)
+    {
+        current = first;
+        offset = 0;
+    }
+    while (current)
+    {
+        uintptr_t base = reinterpret_cast<uintptr_t>(current->data());
+        size_t start = ((base + offset + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+        if (start + bytes <= current->size)
+        {
+            offset = start + bytes;
+            return current->data() + start;
+        }
+        if (!current->next)
+        {
+            break;
+        }
+        current = current->next;
+        offset = 0;
+    }
+
+    Block *block = newBlock(std::max({default_block_size, bytes + alignment, capacity()}));
+    if (current)
+    {
+        current->next = block;
+    }
+    else
+    {
+        first = block;
+    }
+    current = block;
+    offset = 0;
+    return allocate(bytes, alignment);
+}
+
+// Rewinding all the way back merges a chain of blocks into one block as large
+// as all of them. Whatever fitted in the chain, with the space it skipped,
+// fits in the single block, so repeating the same work never grows it again.
+void Arena::rewind(const Mark &mark)
+{
+    current = mark.block;
+    offset = mark.offset;
+    if (!current && first && first->next)
+    {
+        size_t total = capacity();
+        freeBlocks();
+        first = newBlock(total);
+    }
+}
+
+Arena::Block *Arena::newBlock(size_t size)
+{
+    Block *block = static_cast<Block *>(::operator new(sizeof(Block) + size));
+    block->next = nullptr;
+    block->size = size;
+    ++block_count;
+    block_allocations.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void Arena::freeBlocks()
+{
+    while (first)
+    {
+        Block *next = first->next;
+        ::operator delete(first);
+        first = next;
+    }
+}
+
+size_t Arena::capacity() const
+{
+    size_t total = 0;
+    for (const Block *block = first; block; block = block->next)
+    {
+        total += block->size;
+    }
+    return total;
+}
@@ -0,0 +1,76 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-thread bump allocator for transient render data. Allocations are carved
+// out of blocks the arena keeps for the life of the thread and are released
+// together by rewinding to an earlier mark, so once the blocks have grown to
+// fit a tile, rendering more tiles touches the heap no more. Growth is
+// geometric and a full rewind merges the blocks into one, so that point is
+// reached after a few tiles.
+class Arena
+{
+public:
+    struct Block;
+    struct Mark
+    {
+        Block *block;
+        size_t offset;
+    };
+
+    Arena() = default;
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // The calling thread's arena.
+    static Arena &local();
+    // Number of blocks any arena has taken from the heap so far.
+    static uint64_t blockAllocations();
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    Mark mark() const { return {current, offset}; }
+    void rewind(const Mark &mark);
+    size_t capacity() const;
+    // Blocks this arena has taken from the heap; each costs one allocation.
+    size_t blockCount() const { return block_count; }
+
+private:
+    static constexpr size_t default_block_size = 256 * 1024;
+
+    Block *newBlock(size_t size);
+    void freeBlocks();
+
+    // Blocks form a singly linked list with the header in front of the data,
+    // so growing never reallocates bookkeeping. current is null before the
+    // first allocation after a rewind to an empty mark.
+    Block *first = nullptr;
+    Block *current = nullptr;
+    size_t offset = 0;
+    size_t block_count = 0;
+};
+
+// Rewinds an arena to where it was when the scope was entered. Scopes nest.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena &arena) : arena(arena), saved(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(saved); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    Arena &arena;
+    Arena::Mark saved;
+};
+
+#endif
@@ -1,47 +1,27 @@
 #include "binary_shader.h"
 #include <limits>
 
-ShaderResult BinaryShader::calculateColor(const Ray &ray, const std::vector<Sphere> &spheres, const std::vector<Cylinder> &cylinders, const std::vector<Triangle> &triangles, const std::vector<float> &backgroundcolor)
+// Hardcoded color for binary mode
+static const Vec3 kHitColor = {1.0f, 0.0f, 0.0f};
+
+ShaderResult BinaryShader::calculateColor(const Ray &ray, const Scene &scene, const Vec3 &backgroundcolor)
 {
-    float closestT = std::numeric_limits<float>::max();
-    bool intersected = false;
-    std::vector<float> intersected_color = backgroundcolor;
+    Vec3 intersected_color = backgroundcolor;
 
-    // Check intersection with spheres
-    for (const auto &sphere : spheres)
+    bool intersected = scene.occluded(ray);
+    if (intersected)
     {
-        float t;
-        if (sphere.intersectSphere(ray, t) && t < closestT)
-        {
-            closestT = t;
-            intersected = true;
-            intersected_color = {1.0f, 0.0f, 0.0f}; // Hardcoded color for binary mode
-        }
+        intersected_color = kHitColor;
     }
 
-    // Check intersection with cylinders
-    for (const auto &cylinder : cylinders)
-    {
-        float t;
-        if (cylinder.intersectCylinder(ray, t) && t < closestT)
-        {
-            closestT = t;
-            intersected = true;
-            intersected_color = {1.0f, 0.0f, 0.0f};
-        }
-    }
+    return {intersected_color, intersected, {0.0f, 0.0f, 0.0f}, nullptr, {0.0f, 0.0f, 0.0f}, HitRecord()};
+}
 
-    // Check intersection with triangles
-    for (const auto &triangle : triangles)
+void BinaryShader::calculateColors(const Ray *rays, int count, const Scene &scene, const Vec3 &backgroundcolor, Vec3 *colors)
+{
+    uint64_t covered = scene.occluded(rays, count);
+    for (int i = 0; i < count; ++i)
     {
-        float t;
-        if (triangle.intersectTriangle(ray, t) && t < closestT)
-        {
-            closestT = t;
-            intersected = true;
-            intersected_color = {1.0f, 0.0f, 0.0f};
-        }
+        colors[i] = (covered >> i & 1) ? kHitColor : backgroundcolor;
     }
-
-    return {intersected_color, intersected, {0.0f, 0.0f, 0.0f}, Material(), {0.0f, 0.0f, 0.0f}};
 }
\ No newline at end of file
@@ -4,15 +4,17 @@
 #include <vector>
 #include "material.h"
 #include "ray.h"
-#include "sphere.h"
-#include "cylinder.h"
-#include "triangle.h"
+#include "scene.h"
 #include "shader_result.h"
 
 class BinaryShader
 {
 public:
-    static ShaderResult calculateColor(const Ray &ray, const std::vector<Sphere> &spheres, const std::vector<Cylinder> &cylinders, const std::vector<Triangle> &triangles, const std::vector<float> &backgroundcolor);
+    // Every hit gets the same color, so an any-hit query is all it takes;
+    // the result carries no hit record.
+    static ShaderResult calculateColor(const Ray &ray, const Scene &scene, const Vec3 &backgroundcolor);
+    // Colors of up to RayPacket::kMaxRays rays, answered by one packet query.
+    static void calculateColors(const Ray *rays, int count, const Scene &scene, const Vec3 &backgroundcolor, Vec3 *colors);
 };
 
 #endif
\ No newline at end of file
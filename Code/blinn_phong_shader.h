@@ -4,17 +4,23 @@
 #include <vector>
 #include "material.h"
 #include "ray.h"
-#include "sphere.h"
-#include "cylinder.h"
-#include "triangle.h"
+#include "scene.h"
 #include "light.h"
 #include "shader_result.h"
 
 class BlinnPhongShader
 {
 public:
-    static std::vector<float> calculateColor(const std::vector<float> &intersectionPoint, const std::vector<float> &normal, const std::vector<float> &viewDir, const Material &material, const std::vector<Light> &lights, const std::vector<Sphere> &spheres, const std::vector<Cylinder> &cylinders, const std::vector<Triangle> &triangles);
-    static ShaderResult intersectionTests(const Ray &ray, const std::vector<Sphere> &spheres, const std::vector<Cylinder> &cylinders, const std::vector<Triangle> &triangles, std::vector<float> &backgroundcolor);
+    // Ambient term, and the diffuse plus specular term of one unshadowed
+    // light; calculateColor adds them up for the lights that are visible.
+    // With specular false the highlight is left out, which only matches the
+    // full model for ShadingKernel::Diffuse materials.
+    static Vec3 ambientTerm(const Material &material);
+    template <bool specular>
+    static Vec3 lightTerm(const Vec3 &intersectionPoint, const Vec3 &normal, const Vec3 &viewDir, const Material &material, const Light &light);
+    template <bool specular>
+    static Vec3 calculateColor(const HitRecord &hit, const Vec3 &intersectionPoint, const Vec3 &normal, const Vec3 &viewDir, const Material &material, const std::vector<Light> &lights, const Scene &scene);
+    static ShaderResult intersectionTests(const Ray &ray, const Scene &scene, const Vec3 &backgroundcolor);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,554 @@
+#include "bvh.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t mortonCode(float x, float y, float z)
+{
+    auto quantize = [](float v) {
+        return static_cast<uint32_t>(std::min(std::max(v * 1024.0f, 0.0f), 1023.0f));
+    };
+    return (expandBits(quantize(x)) << 2) | (expandBits(quantize(y)) << 1) | expandBits(quantize(z));
+}
+
+// Parallel build in two phases. Primitives are first sorted by the Morton code
+// of their centroid and the top levels are split on Morton bits, which is cheap
+// and yields independent subtrees quickly. Each subtree is then built with
+// binned SAH as its own task; large nodes also bin their centroids in parallel.
+namespace
+{
+const int kMaxLeafSize = 8;
+const int kMaxDepth = 64;
+const int kBinCount = 16;
+const float kTraversalCost = 1.0f;
+const size_t kParallelBinThreshold = 1 << 16;
+const size_t kTaskThreshold = 4096;
+
+struct Bin
+{
+    Aabb bounds;
+    int count = 0;
+};
+
+class Builder
+{
+public:
+    Builder(Bvh &bvh, const std::vector<Aabb> &primitive_bounds, ThreadPool &pool)
+        : bvh(bvh), primitive_bounds(primitive_bounds), pool(pool) {}
+
+    void build();
+    void rebuild(int node, size_t begin, size_t end, int depth);
+
+private:
+    int allocatePair() { return node_count.fetch_add(2); }
+    void buildMorton(int node, size_t begin, size_t end, int bit, int depth);
+    void buildSah(int node, size_t begin, size_t end, int depth);
+    void makeLeaf(int node, size_t begin, size_t end);
+    void computeBounds(size_t begin, size_t end, Aabb &bounds, Aabb &centroid_bounds) const;
+    void binCentroids(size_t begin, size_t end, int axis, const Aabb &centroid_bounds, Bin bins[kBinCount]) const;
+
+    Bvh &bvh;
+    const std::vector<Aabb> &primitive_bounds;
+    ThreadPool &pool;
+    std::vector<float> centroids;
+    std::vector<uint32_t> morton;
+    std::atomic<int> node_count{1};
+    size_t treelet_size = 0;
+};
+
+void Builder::build()
+{
+    size_t count = primitive_bounds.size();
+    centroids.resize(3 * count);
+    parallelFor(pool, 0, count, 8192, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                centroids[3 * i + axis] = primitive_bounds[i].centroid(axis);
+            }
+        }
+    });
+
+    bvh.nodes.resize(std::max<size_t>(1, 2 * count - 1));
+    treelet_size = std::max(kTaskThreshold, count / (4 * (pool.size() + 1)));
+    if (count <= treelet_size)
+    {
+        buildSah(0, 0, count, 0);
+    }
+    else
+    {
+        // Morton presort: order primitives along a Z-curve over the centroid box.
+        Aabb bounds, centroid_bounds;
+        computeBounds(0, count, bounds, centroid_bounds);
+        float scale[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+            scale[axis] = extent > 0.0f ? 1.0f / extent : 0.0f;
+        }
+
+        std::vector<uint64_t> keys(count);
+        parallelFor(pool, 0, count, 8192, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                uint32_t code = mortonCode((centroids[3 * i] - centroid_bounds.min[0]) * scale[0],
+                                           (centroids[3 * i + 1] - centroid_bounds.min[1]) * scale[1],
+                                           (centroids[3 * i + 2] - centroid_bounds.min[2]) * scale[2]);
+                keys[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint32_t>(i);
+            }
+        });
+
+        // Sort chunks in parallel, then merge neighbouring runs pairwise.
+        size_t runs = static_cast<size_t>(pool.size() + 1);
+        std::vector<size_t> run_bounds(runs + 1);
+        for (size_t r = 0; r <= runs; ++r)
+        {
+            run_bounds[r] = count * r / runs;
+        }
+        parallelFor(pool, 0, runs, 1, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r)
+            {
+                std::sort(keys.begin() + run_bounds[r], keys.begin() + run_bounds[r + 1]);
+            }
+        });
+        for (size_t width = 1; width < runs; width *= 2)
+        {
+            size_t pairs = (runs + 2 * width - 1) / (2 * width);
+            parallelFor(pool, 0, pairs, 1, [&](size_t begin, size_t end) {
+                for (size_t pair = begin; pair < end; ++pair)
+                {
+                    size_t first = run_bounds[std::min(runs, 2 * width * pair)];
+                    size_t middle = run_bounds[std::min(runs, 2 * width * pair + width)];
+                    size_t last = run_bounds[std::min(runs, 2 * width * pair + 2 * width)];
+                    std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+                }
+            });
+        }
+
+        morton.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            bvh.indices[i] = static_cast<int>(keys[i] & 0xFFFFFFFFu);
+            morton[i] = static_cast<uint32_t>(keys[i] >> 32);
+        }
+        buildMorton(0, 0, count, 29, 0);
+    }
+
+    bvh.nodes.resize(node_count.load());
+}
+
+void Builder::rebuild(int node, size_t begin, size_t end, int depth)
+{
+    centroids.resize(3 * primitive_bounds.size());
+    parallelFor(pool, begin, end, 8192, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i)
+        {
+            int id = bvh.indices[i];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                centroids[3 * id + axis] = primitive_bounds[id].centroid(axis);
+            }
+        }
+    });
+
+    // The subtree root keeps its slot; everything below it is appended.
+    size_t base = bvh.nodes.size();
+    node_count.store(static_cast<int>(base));
+    bvh.nodes.resize(base + 2 * (end - begin));
+    buildSah(node, begin, end, depth);
+    bvh.nodes.resize(node_count.load());
+}
+
+void Builder::buildMorton(int node, size_t begin, size_t end, int bit, int depth)
+{
+    // Skip bits on which the whole range agrees.
+    while (bit >= 0 && ((morton[begin] ^ morton[end - 1]) >> bit & 1) == 0)
+    {
+        --bit;
+    }
+    if (end - begin <= treelet_size || bit < 0 || depth >= kMaxDepth / 2)
+    {
+        buildSah(node, begin, end, depth);
+        return;
+    }
+
+    uint32_t mask = 1u << bit;
+    size_t split = std::partition_point(morton.begin() + begin, morton.begin() + end, [&](uint32_t code) {
+        return (code & mask) == 0;
+    }) - morton.begin();
+
+    int left = allocatePair();
+    TaskGroup group(pool);
+    group.run([=] { buildMorton(left, begin, split, bit - 1, depth + 1); });
+    buildMorton(left + 1, split, end, bit - 1, depth + 1);
+    group.wait();
+
+    BvhNode &parent = bvh.nodes[node];
+    parent.bounds = bvh.nodes[left].bounds;
+    parent.bounds.expand(bvh.nodes[left + 1].bounds);
+    parent.left_first = left;
+    parent.count = 0;
+}
+
+void Builder::computeBounds(size_t begin, size_t end, Aabb &bounds, Aabb &centroid_bounds) const
+{
+    auto accumulate = [&](size_t first, size_t last, Aabb &box, Aabb &centroid_box) {
+        for (size_t i = first; i < last; ++i)
+        {
+            int id = bvh.indices[i];
+            box.expand(primitive_bounds[id]);
+            centroid_box.expand(&centroids[3 * id]);
+        }
+    };
+
+    if (end - begin < kParallelBinThreshold)
+    {
+        accumulate(begin, end, bounds, centroid_bounds);
+        return;
+    }
+
+    size_t chunks = static_cast<size_t>(pool.size() + 1);
+    std::vector<Aabb> partial(2 * chunks);
+    parallelFor(pool, 0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            accumulate(begin + (end - begin) * chunk / chunks, begin + (end - begin) * (chunk + 1) / chunks,
+                       partial[2 * chunk], partial[2 * chunk + 1]);
+        }
+    });
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        bounds.expand(partial[2 * chunk]);
+        centroid_bounds.expand(partial[2 * chunk + 1]);
+    }
+}
+
+void Builder::binCentroids(size_t begin, size_t end, int axis, const Aabb &centroid_bounds, Bin bins[kBinCount]) const
+{
+    float origin = centroid_bounds.min[axis];
+    float scale = kBinCount / (centroid_bounds.max[axis] - origin);
+    auto accumulate = [&](size_t first, size_t last, Bin *out) {
+        for (size_t i = first; i < last; ++i)
+        {
+            int id = bvh.indices[i];
+            int bin = std::min(kBinCount - 1, static_cast<int>((centroids[3 * id + axis] - origin) * scale));
+            out[bin].count++;
+            out[bin].bounds.expand(primitive_bounds[id]);
+        }
+    };
+
+    if (end - begin < kParallelBinThreshold)
+    {
+        accumulate(begin, end, bins);
+        return;
+    }
+
+    size_t chunks = static_cast<size_t>(pool.size() + 1);
+    std::vector<Bin> partial(chunks * kBinCount);
+    parallelFor(pool, 0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            accumulate(begin + (end - begin) * chunk / chunks, begin + (end - begin) * (chunk + 1) / chunks,
+                       &partial[chunk * kBinCount]);
+        }
+    });
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        for (int b = 0; b < kBinCount; ++b)
+        {
+            bins[b].count += partial[chunk * kBinCount + b].count;
+            bins[b].bounds.expand(partial[chunk * kBinCount + b].bounds);
+        }
+    }
+}
+
+void Builder::makeLeaf(int node, size_t begin, size_t end)
+{
+    // Ascending ids inside a leaf keep primitives of the same kind together.
+    std::sort(bvh.indices.begin() + begin, bvh.indices.begin() + end);
+    bvh.nodes[node].left_first = static_cast<int>(begin);
+    bvh.nodes[node].count = static_cast<int>(end - begin);
+}
+
+void Builder::buildSah(int node, size_t begin, size_t end, int depth)
+{
+    size_t count = end - begin;
+    Aabb bounds, centroid_bounds;
+    computeBounds(begin, end, bounds, centroid_bounds);
+    bvh.nodes[node].bounds = bounds;
+
+    if (count <= 2 || depth >= kMaxDepth)
+    {
+        makeLeaf(node, begin, end);
+        return;
+    }
+
+    // Evaluate every bin boundary on every axis and keep the cheapest split.
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (centroid_bounds.max[axis] <= centroid_bounds.min[axis])
+        {
+            continue;
+        }
+        Bin bins[kBinCount];
+        binCentroids(begin, end, axis, centroid_bounds, bins);
+
+        float right_area[kBinCount];
+        int right_count[kBinCount];
+        Aabb right_box;
+        int right_total = 0;
+        for (int b = kBinCount - 1; b > 0; --b)
+        {
+            right_box.expand(bins[b].bounds);
+            right_total += bins[b].count;
+            right_area[b] = right_box.surfaceArea();
+            right_count[b] = right_total;
+        }
+
+        Aabb left_box;
+        int left_total = 0;
+        for (int b = 0; b < kBinCount - 1; ++b)
+        {
+            left_box.expand(bins[b].bounds);
+            left_total += bins[b].count;
+            if (left_total == 0 || right_count[b + 1] == 0)
+            {
+                continue;
+            }
+            float cost = left_box.surfaceArea() * left_total + right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    // best_axis < 0 means every centroid coincides and no split can separate them.
+    float leaf_cost = bounds.surfaceArea() * count;
+    best_cost = kTraversalCost * bounds.surfaceArea() + best_cost;
+    if (best_axis < 0 || (best_cost >= leaf_cost && count <= static_cast<size_t>(kMaxLeafSize)))
+    {
+        makeLeaf(node, begin, end);
+        return;
+    }
+
+    float origin = centroid_bounds.min[best_axis];
+    float scale = kBinCount / (centroid_bounds.max[best_axis] - origin);
+    int *first = bvh.indices.data() + begin;
+    int *middle = std::partition(first, first + count, [&](int id) {
+        int bin = std::min(kBinCount - 1, static_cast<int>((centroids[3 * id + best_axis] - origin) * scale));
+        return bin < best_split;
+    });
+    size_t split = begin + static_cast<size_t>(middle - first);
+
+    int left = allocatePair();
+    bvh.nodes[node].left_first = left;
+    bvh.nodes[node].count = 0;
+
+    if (count >= kTaskThreshold)
+    {
+        TaskGroup group(pool);
+        group.run([=] { buildSah(left, begin, split, depth + 1); });
+        buildSah(left + 1, split, end, depth + 1);
+        group.wait();
+    }
+    else
+    {
+        buildSah(left, begin, split, depth + 1);
+        buildSah(left + 1, split, end, depth + 1);
+    }
+}
+} // namespace
+
+void Bvh::build(const std::vector<Aabb> &primitive_bounds)
+{
+    nodes.clear();
+    indices.resize(primitive_bounds.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = static_cast<int>(i);
+    }
+    if (indices.empty())
+    {
+        return;
+    }
+
+    Builder builder(*this, primitive_bounds, ThreadPool::shared());
+    builder.build();
+    computeQuality(built_quality);
+    orphaned_nodes = 0;
+}
+
+std::vector<int> Bvh::reachableNodes() const
+{
+    // Preorder: every node appears before its children.
+    std::vector<int> order;
+    if (nodes.empty())
+    {
+        return order;
+    }
+    order.reserve(nodes.size() - orphaned_nodes);
+    std::vector<int> stack = {0};
+    while (!stack.empty())
+    {
+        int node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+        if (nodes[node].count == 0)
+        {
+            stack.push_back(nodes[node].left_first + 1);
+            stack.push_back(nodes[node].left_first);
+        }
+    }
+    return order;
+}
+
+void Bvh::computeQuality(std::vector<float> &quality) const
+{
+    std::vector<float> cost(nodes.size(), 0.0f);
+    quality.assign(nodes.size(), 0.0f);
+    std::vector<int> order = reachableNodes();
+    for (auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        const BvhNode &node = nodes[*it];
+        float area = node.bounds.surfaceArea();
+        if (node.count > 0)
+        {
+            cost[*it] = area * node.count;
+        }
+        else
+        {
+            cost[*it] = kTraversalCost * area + cost[node.left_first] + cost[node.left_first + 1];
+        }
+        quality[*it] = area > 0.0f ? cost[*it] / area : 0.0f;
+    }
+}
+
+float Bvh::sahCost() const
+{
+    std::vector<float> quality;
+    computeQuality(quality);
+    return quality.empty() ? 0.0f : quality[0];
+}
+
+int Bvh::refit(const std::vector<Aabb> &primitive_bounds, float rebuild_threshold)
+{
+    if (nodes.empty())
+    {
+        return 0;
+    }
+
+    // Bottom-up bounds, plus each subtree's index range and node count so a
+    // degraded subtree can be rebuilt over its own primitives.
+    std::vector<int> order = reachableNodes();
+    std::vector<size_t> range_begin(nodes.size()), range_end(nodes.size());
+    std::vector<size_t> subtree_nodes(nodes.size(), 1);
+    for (auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        BvhNode &node = nodes[*it];
+        node.bounds = Aabb();
+        if (node.count > 0)
+        {
+            for (int i = node.left_first; i < node.left_first + node.count; ++i)
+            {
+                node.bounds.expand(primitive_bounds[indices[i]]);
+            }
+            range_begin[*it] = node.left_first;
+            range_end[*it] = node.left_first + node.count;
+        }
+        else
+        {
+            int left = node.left_first;
+            node.bounds.expand(nodes[left].bounds);
+            node.bounds.expand(nodes[left + 1].bounds);
+            range_begin[*it] = range_begin[left];
+            range_end[*it] = range_end[left + 1];
+            subtree_nodes[*it] = 1 + subtree_nodes[left] + subtree_nodes[left + 1];
+        }
+    }
+
+    if (rebuild_threshold <= 0.0f)
+    {
+        return 0;
+    }
+
+    std::vector<float> quality;
+    computeQuality(quality);
+    if (quality[0] > rebuild_threshold * built_quality[0])
+    {
+        build(primitive_bounds);
+        return 1;
+    }
+
+    // Top-down: rebuild the highest subtrees past the threshold and skip
+    // everything below them.
+    std::vector<std::pair<int, int>> rebuilt;
+    std::vector<std::pair<int, int>> stack = {{0, 0}};
+    while (!stack.empty())
+    {
+        int node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        if (nodes[node].count > 0)
+        {
+            continue;
+        }
+        if (built_quality[node] > 0.0f && quality[node] > rebuild_threshold * built_quality[node])
+        {
+            rebuilt.push_back({node, depth});
+            continue;
+        }
+        stack.push_back({nodes[node].left_first, depth + 1});
+        stack.push_back({nodes[node].left_first + 1, depth + 1});
+    }
+    if (rebuilt.empty())
+    {
+        return 0;
+    }
+
+    size_t old_size = nodes.size();
+    Builder builder(*this, primitive_bounds, ThreadPool::shared());
+    for (const auto &subtree : rebuilt)
+    {
+        orphaned_nodes += subtree_nodes[subtree.first] - 1;
+        builder.rebuild(subtree.first, range_begin[subtree.first], range_end[subtree.first], subtree.second);
+    }
+
+    // Too much dead space from replaced subtrees: start over compactly.
+    if (orphaned_nodes > nodes.size() / 2)
+    {
+        build(primitive_bounds);
+        return static_cast<int>(rebuilt.size());
+    }
+
+    // Ancestors of the rebuilt subtrees need their bounds refreshed, and the
+    // new subtrees become the baseline for future degradation checks.
+    refit(primitive_bounds);
+    computeQuality(quality);
+    built_quality.resize(nodes.size(), 0.0f);
+    for (size_t i = old_size; i < nodes.size(); ++i)
+    {
+        built_quality[i] = quality[i];
+    }
+    for (const auto &subtree : rebuilt)
+    {
+        built_quality[subtree.first] = quality[subtree.first];
+    }
+    return static_cast<int>(rebuilt.size());
+}
@@ -0,0 +1,207 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "aabb.h"
+#include "ray.h"
+#include "ray_packet.h"
+
+// Interior nodes keep their two children next to each other at left_first and
+// left_first + 1; leaves (count > 0) own indices[left_first, left_first + count).
+struct BvhNode
+{
+    Aabb bounds;
+    int left_first;
+    int count;
+};
+
+// 30-bit Morton code of a point with coordinates in [0, 1], 10 bits per axis.
+uint32_t mortonCode(float x, float y, float z);
+
+// Binary bounding volume hierarchy over an arbitrary set of primitive bounds.
+// The tree only stores primitive ids; callers resolve them in the leaf callback.
+class Bvh
+{
+public:
+    void build(const std::vector<Aabb> &primitive_bounds);
+    bool empty() const { return nodes.empty(); }
+
+    // Updates node bounds bottom-up after primitives moved (same ids, same
+    // topology). With rebuild_threshold > 0, any subtree whose SAH cost per unit
+    // area grew by more than that factor since it was built is rebuilt in place.
+    // Returns the number of subtrees rebuilt.
+    int refit(const std::vector<Aabb> &primitive_bounds, float rebuild_threshold = 0.0f);
+    float sahCost() const;
+
+    // Visits the leaves the ray can reach within (t_min, t_max), nearest child
+    // first. The callback may shrink ray.t_max and returns true to stop the
+    // traversal early.
+    template <typename LeafFn>
+    void traverse(Ray &ray, LeafFn &&leaf) const;
+
+    // Any-hit traversal of a whole packet: visits, in no particular order,
+    // every leaf some ray of active reaches. leaf(node, mask) gets the rays
+    // that reach the leaf's box and returns those it has answered, which are
+    // dropped from active; traversal ends once active is empty.
+    template <typename LeafFn>
+    void traversePacket(const RayPacket &packet, uint64_t &active, LeafFn &&leaf) const;
+
+    std::vector<BvhNode> nodes;
+    std::vector<int> indices;
+
+private:
+    std::vector<int> reachableNodes() const;
+    void computeQuality(std::vector<float> &quality) const;
+
+    // SAH cost of each subtree divided by its root's surface area, as built.
+    std::vector<float> built_quality;
+    size_t orphaned_nodes = 0;
+};
+
+template <typename LeafFn>
+void Bvh::traverse(Ray &ray, LeafFn &&leaf) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    struct Entry
+    {
+        int node;
+        float t_entry;
+    };
+    Entry stack[128];
+    int top = 0;
+
+    float t_root;
+    if (!nodes[0].bounds.intersect(ray, t_root))
+    {
+        return;
+    }
+    stack[top++] = {0, t_root};
+
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        if (entry.t_entry > ray.t_max)
+        {
+            continue;
+        }
+
+        const BvhNode &node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            if (leaf(node))
+            {
+                return;
+            }
+            continue;
+        }
+
+        int left = node.left_first;
+        int right = left + 1;
+        float t_left = 0.0f, t_right = 0.0f;
+        bool hit_left = nodes[left].bounds.intersect(ray, t_left);
+        bool hit_right = nodes[right].bounds.intersect(ray, t_right);
+
+        // Push the far child first so the near one is popped next.
+        if (hit_left && hit_right)
+        {
+            if (t_left < t_right)
+            {
+                stack[top++] = {right, t_right};
+                stack[top++] = {left, t_left};
+            }
+            else
+            {
+                stack[top++] = {left, t_left};
+                stack[top++] = {right, t_right};
+            }
+        }
+        else if (hit_left)
+        {
+            stack[top++] = {left, t_left};
+        }
+        else if (hit_right)
+        {
+            stack[top++] = {right, t_right};
+        }
+    }
+}
+
+template <typename LeafFn>
+void Bvh::traversePacket(const RayPacket &packet, uint64_t &active, LeafFn &&leaf) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    struct Entry
+    {
+        int node;
+        uint64_t mask;
+    };
+    Entry stack[128];
+    int top = 0;
+
+    uint64_t root = packet.intersect(nodes[0].bounds, active);
+    if (root)
+    {
+        stack[top++] = {0, root};
+    }
+
+    while (top > 0 && active)
+    {
+        Entry entry = stack[--top];
+        uint64_t mask = entry.mask & active;
+        if (!mask)
+        {
+            continue;
+        }
+
+        const BvhNode &node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            active &= ~leaf(node, mask);
+            continue;
+        }
+
+        // Visit the child nearer along the packet's first ray first, judged
+        // on the axis that separates the two children the most; finding a
+        // blocker early retires rays before the far child is opened.
+        int near = node.left_first;
+        int far = near + 1;
+        int axis = 0;
+        float separation = -1.0f;
+        for (int a = 0; a < 3; ++a)
+        {
+            float d = std::fabs(nodes[far].bounds.centroid(a) - nodes[near].bounds.centroid(a));
+            if (d > separation)
+            {
+                separation = d;
+                axis = a;
+            }
+        }
+        if ((nodes[near].bounds.centroid(axis) > nodes[far].bounds.centroid(axis)) == (packet.rays[0].direction[axis] >= 0.0f))
+        {
+            std::swap(near, far);
+        }
+        uint64_t far_mask = packet.intersect(nodes[far].bounds, mask);
+        uint64_t near_mask = packet.intersect(nodes[near].bounds, mask);
+        if (far_mask)
+        {
+            stack[top++] = {far, far_mask};
+        }
+        if (near_mask)
+        {
+            stack[top++] = {near, near_mask};
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Camera
+{
+    std::string type;
+    int width;
+    int height;
+    std::vector<float> position;
+    std::vector<float> lookAt;
+    std::vector<float> upVector;
+    float fov;
+    float exposure;
+    // Jittered anti-aliasing samples per pixel; 1 shoots through the pixel center.
+    int samples = 1;
+    uint32_t seed = 0;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+static const char *kCheckpointMagic = "RTCHECKPOINT 1";
+
+bool RenderCheckpoint::load(const std::string &path, const std::string &settings, std::vector<char> &done,
+                            std::vector<unsigned char> &pixels, float &max_value)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    std::string magic, stored_settings;
+    size_t tile_count = 0, pixel_bytes = 0;
+    float stored_max = 0.0f;
+    std::getline(file, magic);
+    std::getline(file, stored_settings);
+    file >> tile_count >> pixel_bytes >> stored_max;
+    file.get();
+    if (!file || magic != kCheckpointMagic)
+    {
+        std::cerr << "Ignoring unreadable checkpoint " << path << std::endl;
+        return false;
+    }
+    if (stored_settings != settings || tile_count != done.size() || pixel_bytes != pixels.size())
+    {
+        std::cerr << "Ignoring checkpoint " << path << " written with different render settings" << std::endl;
+        return false;
+    }
+
+    std::vector<char> stored_done(tile_count);
+    std::vector<unsigned char> stored_pixels(pixel_bytes);
+    file.read(stored_done.data(), stored_done.size());
+    file.read(reinterpret_cast<char *>(stored_pixels.data()), stored_pixels.size());
+    if (!file)
+    {
+        std::cerr << "Ignoring truncated checkpoint " << path << std::endl;
+        return false;
+    }
+    done.swap(stored_done);
+    pixels.swap(stored_pixels);
+    max_value = stored_max;
+    return true;
+}
+
+bool RenderCheckpoint::save(const std::string &path, const std::string &settings, const std::vector<char> &done,
+                            const std::vector<unsigned char> &pixels, float max_value)
+{
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Error: Could not write checkpoint " << temporary << std::endl;
+            return false;
+        }
+        file.precision(9);
+        file << kCheckpointMagic << "\n" << settings << "\n"
+             << done.size() << " " << pixels.size() << " " << max_value << "\n";
+        file.write(done.data(), done.size());
+        file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+        file.flush();
+        if (!file)
+        {
+            std::cerr << "Error: Could not write checkpoint " << temporary << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "Error: Could not replace checkpoint " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+
+// On-disk snapshot of a partly finished render: a description of the render
+// settings, which work tiles are complete, the running maximum color and the
+// full framebuffer. A checkpoint only resumes a render with identical settings.
+class RenderCheckpoint
+{
+public:
+    // Returns false (leaving the outputs untouched) when there is no usable
+    // checkpoint at path for these settings and this tile and pixel count.
+    static bool load(const std::string &path, const std::string &settings, std::vector<char> &done,
+                     std::vector<unsigned char> &pixels, float &max_value);
+    // Written to a temporary file and renamed over path, so a process killed
+    // mid-write leaves the previous checkpoint intact. Failures are reported on
+    // stderr and do not stop the render.
+    static bool save(const std::string &path, const std::string &settings, const std::vector<char> &done,
+                     const std::vector<unsigned char> &pixels, float max_value);
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "compressed_bvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// Places the node's quantization grid over bounds and marks every child empty.
+static void initNode(CompressedBvhNode &node, const Aabb &bounds)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float scale = (bounds.max[axis] - bounds.min[axis]) / 255.0f;
+        // The grid has to reach the top of the box.
+        while (bounds.min[axis] + 255.0f * scale < bounds.max[axis])
+        {
+            scale = std::nextafter(scale, std::numeric_limits<float>::max());
+        }
+        node.origin[axis] = bounds.min[axis];
+        node.scale[axis] = scale;
+    }
+    std::fill(std::begin(node.children), std::end(node.children), CompressedBvh::kEmptyChild);
+}
+
+void CompressedBvh::build(const Bvh &bvh)
+{
+    nodes.clear();
+    if (bvh.empty())
+    {
+        return;
+    }
+    if (bvh.indices.size() >= (size_t(1) << (31 - kLeafCountBits)))
+    {
+        throw std::runtime_error("Too many primitives for a compressed BVH");
+    }
+
+    // Range of bvh.indices under every binary node; children always follow
+    // their parent, so one backwards sweep fills it.
+    ranges.assign(bvh.nodes.size(), {0, 0});
+    for (size_t n = bvh.nodes.size(); n-- > 0;)
+    {
+        const BvhNode &node = bvh.nodes[n];
+        if (node.count > 0)
+        {
+            ranges[n] = {node.left_first, node.left_first + node.count};
+        }
+        else if (node.left_first > static_cast<int>(n))
+        {
+            ranges[n] = {ranges[node.left_first].first, ranges[node.left_first + 1].second};
+        }
+    }
+
+    max_depth = 1;
+    const BvhNode &root = bvh.nodes[0];
+    if (root.count > 0)
+    {
+        // A single leaf still needs a node to hold its box.
+        nodes.emplace_back();
+        initNode(nodes[0], root.bounds);
+        quantize(nodes[0], 0, root.bounds);
+        uint32_t child = leafChild(root.bounds, root.left_first, root.count, 2);
+        nodes[0].children[0] = child;
+    }
+    else
+    {
+        collapse(bvh, 0, 1);
+    }
+    ranges.clear();
+    ranges.shrink_to_fit();
+    // The binary builder caps its depth, which keeps this far out of reach.
+    if (3 * max_depth + 1 > kStackSize)
+    {
+        nodes.clear();
+        throw std::runtime_error("BVH too deep for a compressed BVH");
+    }
+}
+
+bool CompressedBvh::isLeaf(const Bvh &bvh, int binary_node) const
+{
+    return bvh.nodes[binary_node].count > 0 || ranges[binary_node].second - ranges[binary_node].first <= kMergedLeafSize;
+}
+
+// Pulls up to four descendants of an interior binary node into one wide node,
+// always opening the largest interior child, which keeps the binary tree's
+// SAH structure. Subtrees of at most kMergedLeafSize primitives become one
+// leaf: a few more primitive tests cost less than the nodes they replace.
+uint32_t CompressedBvh::collapse(const Bvh &bvh, int binary_node, int depth)
+{
+    max_depth = std::max(max_depth, depth);
+    int members[4] = {bvh.nodes[binary_node].left_first, bvh.nodes[binary_node].left_first + 1};
+    int member_count = 2;
+    while (member_count < 4)
+    {
+        int widest = -1;
+        float widest_area = -1.0f;
+        for (int m = 0; m < member_count; ++m)
+        {
+            const BvhNode &member = bvh.nodes[members[m]];
+            if (!isLeaf(bvh, members[m]) && member.bounds.surfaceArea() > widest_area)
+            {
+                widest = m;
+                widest_area = member.bounds.surfaceArea();
+            }
+        }
+        if (widest < 0)
+        {
+            break;
+        }
+        // Open in place so members stay in tree order.
+        int opened = members[widest];
+        for (int m = member_count++; m > widest + 1; --m)
+        {
+            members[m] = members[m - 1];
+        }
+        members[widest] = bvh.nodes[opened].left_first;
+        members[widest + 1] = bvh.nodes[opened].left_first + 1;
+    }
+
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    initNode(nodes[index], bvh.nodes[binary_node].bounds);
+
+    for (int m = 0; m < member_count; ++m)
+    {
+        const BvhNode &member = bvh.nodes[members[m]];
+        quantize(nodes[index], m, member.bounds);
+        // Recursion grows nodes, so only index into it afterwards.
+        const std::pair<int, int> &range = ranges[members[m]];
+        uint32_t child = isLeaf(bvh, members[m]) ? leafChild(member.bounds, range.first, range.second - range.first, depth + 1) : collapse(bvh, members[m], depth + 1);
+        nodes[index].children[m] = child;
+    }
+    return index;
+}
+
+// Leaves hold up to 2^kLeafCountBits primitives; a larger one (the builder
+// makes those only for primitives it cannot separate) becomes a node whose
+// children split its range, all sharing the leaf's box.
+uint32_t CompressedBvh::leafChild(const Aabb &bounds, int first, int count, int depth)
+{
+    const int max_count = 1 << kLeafCountBits;
+    if (count <= max_count)
+    {
+        return kLeafFlag | static_cast<uint32_t>(first) << kLeafCountBits | static_cast<uint32_t>(count - 1);
+    }
+    max_depth = std::max(max_depth, depth);
+
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    initNode(nodes[index], bounds);
+    int slice = std::max(max_count, (count + 3) / 4);
+    for (int c = 0; c < 4 && c * slice < count; ++c)
+    {
+        quantize(nodes[index], c, bounds);
+        uint32_t child = leafChild(bounds, first + c * slice, std::min(slice, count - c * slice), depth + 1);
+        nodes[index].children[c] = child;
+    }
+    return index;
+}
+
+void CompressedBvh::quantize(CompressedBvhNode &node, int child, const Aabb &bounds)
+{
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float origin = node.origin[axis];
+        float scale = node.scale[axis];
+        int lower = 0;
+        int upper = 0;
+        if (scale > 0.0f)
+        {
+            lower = std::min(std::max(static_cast<int>(std::floor((bounds.min[axis] - origin) / scale)), 0), 255);
+            upper = std::min(std::max(static_cast<int>(std::ceil((bounds.max[axis] - origin) / scale)), 0), 255);
+            // Division rounding can land a plane just inside the exact box.
+            while (lower > 0 && origin + lower * scale > bounds.min[axis])
+            {
+                --lower;
+            }
+            while (upper < 255 && origin + upper * scale < bounds.max[axis])
+            {
+                ++upper;
+            }
+        }
+        node.lower[axis][child] = static_cast<uint8_t>(lower);
+        node.upper[axis][child] = static_cast<uint8_t>(upper);
+    }
+}
@@ -0,0 +1,184 @@
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include "bvh.h"
+#include "ray.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Four children in one 64-byte cache line. Child boxes are stored as 8-bit
+// planes on a grid spanning the node's own box (origin + q * scale), rounded
+// outwards so they always contain the exact box. Children are either a node
+// index or a leaf range of the source Bvh's indices, packed into 32 bits.
+struct CompressedBvhNode
+{
+    float origin[3];
+    float scale[3];
+    uint8_t lower[3][4];
+    uint8_t upper[3][4];
+    uint32_t children[4];
+};
+
+// Read-only, 4-wide, quantized copy of a binary Bvh for traversal. Collapsing
+// keeps the source's leaves, so leaf ranges index the same bvh.indices and
+// any per-leaf data built for the binary tree stays valid.
+class CompressedBvh
+{
+public:
+    static const uint32_t kEmptyChild = 0xFFFFFFFFu;
+    static const uint32_t kLeafFlag = 0x80000000u;
+    static const int kLeafCountBits = 5;
+    static const int kMergedLeafSize = 4;
+    // Traversal stack entries. Each node visited pops one entry and pushes up
+    // to four, so a tree of depth d needs at most 3 * d + 1.
+    static const int kStackSize = 256;
+
+    // Throws if the tree would be too deep for the traversal stack.
+    void build(const Bvh &bvh);
+    bool empty() const { return nodes.empty(); }
+    size_t memoryBytes() const { return nodes.size() * sizeof(CompressedBvhNode); }
+
+    // Same contract as Bvh::traverse, except the leaf callback receives the
+    // leaf's range as leaf(first, count).
+    template <typename LeafFn>
+    void traverse(Ray &ray, LeafFn &&leaf) const;
+
+    std::vector<CompressedBvhNode> nodes;
+
+private:
+    bool isLeaf(const Bvh &bvh, int binary_node) const;
+    uint32_t collapse(const Bvh &bvh, int binary_node, int depth);
+    uint32_t leafChild(const Aabb &bounds, int first, int count, int depth);
+    static void quantize(CompressedBvhNode &node, int child, const Aabb &bounds);
+
+    // Build scratch: the bvh.indices range under each binary node.
+    std::vector<std::pair<int, int>> ranges;
+    int max_depth = 0;
+};
+
+// Slab test of a ray against all four child boxes of a node. Writes entry
+// distances and returns a bit mask of the children hit within the ray's
+// interval. The SSE path dequantizes and tests all four boxes at once; both
+// paths match Aabb::intersect bit for bit.
+inline int intersectChildren(const CompressedBvhNode &node, const Ray &ray, float t_entry[4])
+{
+#if defined(__SSE2__)
+    __m128 t_near = _mm_set1_ps(ray.t_min);
+    __m128 t_far = _mm_set1_ps(ray.t_max);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        __m128i zero = _mm_setzero_si128();
+        int lower_bytes, upper_bytes;
+        std::memcpy(&lower_bytes, node.lower[axis], 4);
+        std::memcpy(&upper_bytes, node.upper[axis], 4);
+        __m128 lower = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(lower_bytes), zero), zero));
+        __m128 upper = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(upper_bytes), zero), zero));
+        __m128 box_origin = _mm_set1_ps(node.origin[axis]);
+        __m128 scale = _mm_set1_ps(node.scale[axis]);
+        __m128 box_min = _mm_add_ps(box_origin, _mm_mul_ps(lower, scale));
+        __m128 box_max = _mm_add_ps(box_origin, _mm_mul_ps(upper, scale));
+        __m128 ray_origin = _mm_set1_ps(ray.origin[axis]);
+        __m128 inv = _mm_set1_ps(ray.inv_direction[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(ray.sign[axis] ? box_max : box_min, ray_origin), inv);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(ray.sign[axis] ? box_min : box_max, ray_origin), inv);
+        // Operand order keeps the current bound when a product is NaN.
+        t_near = _mm_max_ps(t0, t_near);
+        t_far = _mm_min_ps(t1, t_far);
+    }
+    _mm_storeu_ps(t_entry, t_near);
+    __m128i children = _mm_loadu_si128(reinterpret_cast<const __m128i *>(node.children));
+    int empty = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(children, _mm_set1_epi32(-1))));
+    return _mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & ~empty;
+#else
+    int mask = 0;
+    for (int c = 0; c < 4 && node.children[c] != CompressedBvh::kEmptyChild; ++c)
+    {
+        float t_near = ray.t_min;
+        float t_far = ray.t_max;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float box_min = node.origin[axis] + node.lower[axis][c] * node.scale[axis];
+            float box_max = node.origin[axis] + node.upper[axis][c] * node.scale[axis];
+            float t0 = ((ray.sign[axis] ? box_max : box_min) - ray.origin[axis]) * ray.inv_direction[axis];
+            float t1 = ((ray.sign[axis] ? box_min : box_max) - ray.origin[axis]) * ray.inv_direction[axis];
+            t_near = t0 > t_near ? t0 : t_near;
+            t_far = t1 < t_far ? t1 : t_far;
+        }
+        t_entry[c] = t_near;
+        mask |= (t_near <= t_far) << c;
+    }
+    return mask;
+#endif
+}
+
+template <typename LeafFn>
+void CompressedBvh::traverse(Ray &ray, LeafFn &&leaf) const
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    struct Entry
+    {
+        uint32_t child;
+        float t_entry;
+    };
+    Entry stack[kStackSize];
+    int top = 0;
+    stack[top++] = {0, 0.0f};
+
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        if (entry.t_entry > ray.t_max)
+        {
+            continue;
+        }
+
+        if (entry.child & kLeafFlag)
+        {
+            uint32_t packed = entry.child & ~kLeafFlag;
+            int count = static_cast<int>(packed & ((1u << kLeafCountBits) - 1)) + 1;
+            if (leaf(static_cast<int>(packed >> kLeafCountBits), count))
+            {
+                return;
+            }
+            continue;
+        }
+
+        const CompressedBvhNode &node = nodes[entry.child];
+        float t_entry[4];
+        int mask = intersectChildren(node, ray, t_entry);
+
+        // Order the hits far to near so the nearest is pushed last.
+        Entry hits[4];
+        int hit_count = 0;
+        for (int c = 0; c < 4; ++c)
+        {
+            if (!(mask >> c & 1))
+            {
+                continue;
+            }
+            int slot = hit_count++;
+            while (slot > 0 && hits[slot - 1].t_entry < t_entry[c])
+            {
+                hits[slot] = hits[slot - 1];
+                --slot;
+            }
+            hits[slot] = {node.children[c], t_entry[c]};
+        }
+        for (int h = 0; h < hit_count; ++h)
+        {
+            stack[top++] = hits[h];
+        }
+    }
+}
+
+#endif
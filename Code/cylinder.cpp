@@ -1,6 +1,5 @@
 #include "cylinder.h"
 #include <cmath>
-#include <iostream>
 #include <limits>
 #include <algorithm>
 
@@ -8,201 +7,119 @@ Cylinder::Cylinder(const std::vector<float> &center, float radius, const std::ve
     : center(center), radius(radius), axis(axis), height(height*2), material(material){
     float axis_length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
     this->axis = {axis[0] / axis_length, axis[1] / axis_length, axis[2] / axis_length};
-
+    half_height = this->height * 0.5f;
+
+    const std::vector<float> &w = this->axis;
+    float helper[3] = {1.0f, 0.0f, 0.0f};
+    if (std::fabs(w[0]) > 0.9f)
+    {
+        helper[0] = 0.0f;
+        helper[1] = 1.0f;
+    }
+    frame_u[0] = helper[1] * w[2] - helper[2] * w[1];
+    frame_u[1] = helper[2] * w[0] - helper[0] * w[2];
+    frame_u[2] = helper[0] * w[1] - helper[1] * w[0];
+    float u_length = sqrt(frame_u[0] * frame_u[0] + frame_u[1] * frame_u[1] + frame_u[2] * frame_u[2]);
+    frame_u[0] /= u_length;
+    frame_u[1] /= u_length;
+    frame_u[2] /= u_length;
+    frame_v[0] = w[1] * frame_u[2] - w[2] * frame_u[1];
+    frame_v[1] = w[2] * frame_u[0] - w[0] * frame_u[2];
+    frame_v[2] = w[0] * frame_u[1] - w[1] * frame_u[0];
 }
 
+// Capped cylinder as the intersection of two intervals along the ray: the slab
+// between the cap planes and the inside of the infinite cylinder. The slab is
+// tested first and rejects most rays before the quadratic is touched.
 bool Cylinder::intersectCylinder(const Ray& ray, float& t) const {
-    std::vector<float> oc = {ray.origin[0] - center[0],
-                             ray.origin[1] - center[1],
-                             ray.origin[2] - center[2]};
-     double d_dot_a = ray.direction[0] * axis[0] +
-                    ray.direction[1] * axis[1] +
-                    ray.direction[2] * axis[2];
-    double oc_dot_a = oc[0] * axis[0] +
-                     oc[1] * axis[1] +
-                     oc[2] * axis[2];
-    double a = ray.direction[0] * ray.direction[0] +
-              ray.direction[1] * ray.direction[1] +
-              ray.direction[2] * ray.direction[2] -
-              d_dot_a * d_dot_a;
-    double half_b = oc[0] * ray.direction[0] +
-                   oc[1] * ray.direction[1] +
-                   oc[2] * ray.direction[2] -
-                   oc_dot_a * d_dot_a;
-    double c = oc[0] * oc[0] +
-              oc[1] * oc[1] +
-              oc[2] * oc[2] -
-              oc_dot_a * oc_dot_a -
-              radius * radius;
-    double discriminant = static_cast<double>(half_b) * half_b - a * c;
-
-    double sqrt_discriminant = sqrt(discriminant);
-    double root1 = (-half_b - sqrt_discriminant) / a;
-    double root2 = (-half_b + sqrt_discriminant) / a;
+    float oc[3] = {ray.origin[0] - center[0], ray.origin[1] - center[1], ray.origin[2] - center[2]};
+    const float *d = ray.direction.data();
+
+    float oz = oc[0] * axis[0] + oc[1] * axis[1] + oc[2] * axis[2];
+    float dz = d[0] * axis[0] + d[1] * axis[1] + d[2] * axis[2];
+    if (std::fabs(dz) < 1e-12f)
+    {
+        dz = 1e-12f;
+    }
+    float inv_dz = 1.0f / dz;
+    float slab0 = (-half_height - oz) * inv_dz;
+    float slab1 = (half_height - oz) * inv_dz;
+    float t_near = std::min(slab0, slab1);
+    float t_far = std::max(slab0, slab1);
+    if (t_far <= ray.t_min || t_near >= ray.t_max)
+    {
+        return false;
+    }
 
-    float t_min = std::numeric_limits<float>::max();
-    for (float t_candidate : {root1, root2}) {
-        if (t_candidate > 0) {
-            std::vector<float> point = {
-                ray.origin[0] + t_candidate * ray.direction[0],
-                ray.origin[1] + t_candidate * ray.direction[1],
-                ray.origin[2] + t_candidate * ray.direction[2]};
-            std::vector<float> to_point = {
-                point[0] - center[0],
-                point[1] - center[1],
-                point[2] - center[2]};
-            float projection = to_point[0] * axis[0] +
-                               to_point[1] * axis[1] +
-                               to_point[2] * axis[2];
-            if (projection >= -height / 2 && projection <= height / 2 && t_candidate < t_min) {
-                t_min = t_candidate;
-            }
+    float ox = oc[0] * frame_u[0] + oc[1] * frame_u[1] + oc[2] * frame_u[2];
+    float oy = oc[0] * frame_v[0] + oc[1] * frame_v[1] + oc[2] * frame_v[2];
+    float dx = d[0] * frame_u[0] + d[1] * frame_u[1] + d[2] * frame_u[2];
+    float dy = d[0] * frame_v[0] + d[1] * frame_v[1] + d[2] * frame_v[2];
+
+    float a = dx * dx + dy * dy;
+    float half_b = ox * dx + oy * dy;
+    float c = ox * ox + oy * oy - radius * radius;
+    if (a < 1e-12f)
+    {
+        // Parallel to the axis: either inside the tube for the whole slab or never.
+        if (c > 0.0f)
+        {
+            return false;
         }
     }
-
-    if (t_min < std::numeric_limits<float>::max()) {
-        t = t_min;
-        return true;
+    else
+    {
+        float discriminant = half_b * half_b - a * c;
+        if (discriminant < 0.0f)
+        {
+            return false;
+        }
+        float s = sqrt(discriminant);
+        float inv_a = 1.0f / a;
+        t_near = std::max(t_near, (-half_b - s) * inv_a);
+        t_far = std::min(t_far, (-half_b + s) * inv_a);
     }
 
-    return false;
-    
+    if (t_near > t_far || t_far <= ray.t_min)
+    {
+        return false;
+    }
+    t = t_near > ray.t_min ? t_near : t_far;
+    return t < ray.t_max;
 }
 
-// bool Cylinder::intersectCylinder(const Ray &ray, float &t) const
-// {
-
-//     float side_t = std::numeric_limits<float>::max();
-//     float cap_t = std::numeric_limits<float>::max();
-
-//     float side_root = find_root(ray);
-
-//     if (side_root >= 0)
-//     {
-
-//         std::vector<float> point = {
-//             ray.origin[0] + side_root * ray.direction[0],
-//             ray.origin[1] + side_root * ray.direction[1],
-//             ray.origin[2] + side_root * ray.direction[2]};
-//         std::vector<float> to_point = {
-//             point[0] - center[0],
-//             point[1] - center[1],
-//             point[2] - center[2]};
-//         float projection = to_point[0] * axis[0] +
-//                            to_point[1] * axis[1] +
-//                            to_point[2] * axis[2];
-//         if (projection >= -height && projection <= height)
-//         {
-//             side_t = side_root;
-//         }
-//     }
-
-//     std::vector<float> bottom_center = center;
-//     float bottom_cap_t = std::numeric_limits<float>::max();
-//     if (check_cap_intersection(ray, bottom_cap_t, bottom_center, {-axis[0], -axis[1], -axis[2]}))
-//     {
-//         cap_t = std::min(cap_t, bottom_cap_t);
-//     }
-
-//     std::vector<float> top_center = {center[0] + axis[0] * height, center[1] + axis[1] * height, center[2] + axis[2] * height};
-//     float top_cap_t = std::numeric_limits<float>::max();
-//     if (check_cap_intersection(ray, top_cap_t, top_center, axis))
-//     {
-//         cap_t = std::min(cap_t, top_cap_t);
-//     }
-
-//     t = std::numeric_limits<float>::max();
-//     if(side_t > 0.0f){
-//         t = side_t;
-//     } 
-//     if(cap_t > 0.0f && cap_t < t){
-//         t = cap_t;
-//     }
-//     return t < std::numeric_limits<float>::max();
-    
-
-// }
-
-// bool Cylinder::check_cap_intersection(const Ray &ray, float &t, const std::vector<float> &cap_center, const std::vector<float> &cap_normal) const
-// {
-//     float denom = ray.direction[0] * cap_normal[0] +
-//                   ray.direction[1] * cap_normal[1] +
-//                   ray.direction[2] * cap_normal[2];
-
-//     if (fabs(denom) < 1e-5)
-//     {
-//         return false;
-//     }
-//     float t_cap = ((cap_center[0] - ray.origin[0]) * cap_normal[0] +
-//                    (cap_center[1] - ray.origin[1]) * cap_normal[1] +
-//                    (cap_center[2] - ray.origin[2]) * cap_normal[2]) /
-//                   denom;
-//     if (t_cap < 0)
-//     {
-//         return false;
-//     }
-
-//     std::vector<float> point = {
-//         ray.origin[0] + t_cap * ray.direction[0],
-//         ray.origin[1] + t_cap * ray.direction[1],
-//         ray.origin[2] + t_cap * ray.direction[2]};
-
-//     float dist_squared = (point[0] - cap_center[0]) * (point[0] - cap_center[0]) +
-//                          (point[1] - cap_center[1]) * (point[1] - cap_center[1]) +
-//                          (point[2] - cap_center[2]) * (point[2] - cap_center[2]);
-//     if (dist_squared > radius * radius + 1e-5)
-//     {
-//         return false;
-//     }
-
-//     t = t_cap;
-//     return true;
-// }
-
-// float Cylinder::find_root(const Ray &ray) const
-// {
-//     std::vector<float> oc = {ray.origin[0] - center[0],
-//                              ray.origin[1] - center[1],
-//                              ray.origin[2] - center[2]};
-
-//     double d_dot_a = ray.direction[0] * axis[0] +
-//                     ray.direction[1] * axis[1] +
-//                     ray.direction[2] * axis[2];
-//     double oc_dot_a = oc[0] * axis[0] +
-//                      oc[1] * axis[1] +
-//                      oc[2] * axis[2];
-//     double a = ray.direction[0] * ray.direction[0] +
-//               ray.direction[1] * ray.direction[1] +
-//               ray.direction[2] * ray.direction[2] -
-//               d_dot_a * d_dot_a;
-//     double half_b = oc[0] * ray.direction[0] +
-//                    oc[1] * ray.direction[1] +
-//                    oc[2] * ray.direction[2] -
-//                    oc_dot_a * d_dot_a;
-//     double c = oc[0] * oc[0] +
-//               oc[1] * oc[1] +
-//               oc[2] * oc[2] -
-//               oc_dot_a * oc_dot_a -
-//               radius * radius;
-//     double discriminant = static_cast<double>(half_b) * half_b - a * c;
-
-//     if (discriminant < 1e-6 || fabs(a) < 1e-6)
-//     {
-//         return -1.0f;
-//     }
+// Tight box of the capped cylinder: along each world axis the caps reach
+// half_height * |axis_i| and the rims add radius * sqrt(1 - axis_i^2).
+Aabb Cylinder::bounds() const {
+    Aabb box;
+    for (int i = 0; i < 3; ++i)
+    {
+        float extent = half_height * std::fabs(axis[i]) + radius * sqrt(std::max(0.0f, 1.0f - axis[i] * axis[i]));
+        box.min[i] = center[i] - extent;
+        box.max[i] = center[i] + extent;
+    }
+    return box;
+}
 
-//     double sqrt_discriminant = sqrt(discriminant);
-//     double root1 = (-half_b - sqrt_discriminant) / a;
-//     double root2 = (-half_b + sqrt_discriminant) / a;
-//     if (root1 > 0 && root2 > 0)
-//     {
-//         return std::min(root1, root2);
-//     } else if (root1 > 0)
-//     {
-//         return root1;
-//     } else if (root2 > 0)
-//     {
-//         return root2;
-//     }
-//     return -1.0f;
-// }
\ No newline at end of file
+Vec3 Cylinder::normalAt(const Vec3& point) const {
+    float pc[3] = {point[0] - center[0], point[1] - center[1], point[2] - center[2]};
+    float along = pc[0] * axis[0] + pc[1] * axis[1] + pc[2] * axis[2];
+    Vec3 radial = {pc[0] - along * axis[0],
+                   pc[1] - along * axis[1],
+                   pc[2] - along * axis[2]};
+    float radial_length = sqrt(radial[0] * radial[0] + radial[1] * radial[1] + radial[2] * radial[2]);
+
+    // Whichever surface the point is closest to decides between cap and side.
+    if (std::fabs(std::fabs(along) - half_height) < std::fabs(radial_length - radius))
+    {
+        float sign = along > 0.0f ? 1.0f : -1.0f;
+        return {sign * axis[0], sign * axis[1], sign * axis[2]};
+    }
+    if (radial_length > 0.0f)
+    {
+        radial[0] /= radial_length;
+        radial[1] /= radial_length;
+        radial[2] /= radial_length;
+    }
+    return radial;
+}
\ No newline at end of file
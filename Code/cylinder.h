@@ -4,19 +4,26 @@
 #include "ray.h"
 #include <vector>
 #include "material.h"
+#include "aabb.h"
 
 class Cylinder {
     public:
 
         Cylinder(const std::vector<float>& center, float radius, const std::vector<float>& axis, float height, Material material);
         bool intersectCylinder(const Ray& ray, float& t) const;
-        float find_root(const Ray& ray) const;
-        bool check_cap_intersection(const Ray& ray, float& t, const std::vector<float>& cap_center, const std::vector<float>& cap_normal) const;
+        Vec3 normalAt(const Vec3& point) const;
+        Aabb bounds() const;
         std::vector<float> center;
         float radius;
         std::vector<float> axis;
         float height;
         Material material;
+
+        // Orthonormal frame (frame_u, frame_v, axis) precomputed at load time so
+        // the kernel can work in cylinder-local coordinates.
+        float frame_u[3];
+        float frame_v[3];
+        float half_height;
     
     private:
 };
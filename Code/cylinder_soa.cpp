@@ -0,0 +1,150 @@
+#include "cylinder_soa.h"
+#include "simd.h"
+
+void CylinderSoA::build(const std::vector<Cylinder> &cylinders, const std::vector<int> &order)
+{
+    count = static_cast<int>(order.size());
+
+    // Padding cylinders have a negative half height, so their slab is empty.
+    size_t padded = order.size() + kSimdWidth;
+    for (std::vector<float> *column : {&cx, &cy, &cz, &ux, &uy, &uz, &vx, &vy, &vz, &wx, &wy, &wz, &r2})
+    {
+        column->assign(padded, 0.0f);
+    }
+    wz.assign(padded, 1.0f);
+    half_height.assign(padded, -1.0f);
+    cylinder_index = order;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Cylinder &cylinder = cylinders[order[i]];
+        cx[i] = cylinder.center[0];
+        cy[i] = cylinder.center[1];
+        cz[i] = cylinder.center[2];
+        ux[i] = cylinder.frame_u[0];
+        uy[i] = cylinder.frame_u[1];
+        uz[i] = cylinder.frame_u[2];
+        vx[i] = cylinder.frame_v[0];
+        vy[i] = cylinder.frame_v[1];
+        vz[i] = cylinder.frame_v[2];
+        wx[i] = cylinder.axis[0];
+        wy[i] = cylinder.axis[1];
+        wz[i] = cylinder.axis[2];
+        r2[i] = cylinder.radius * cylinder.radius;
+        half_height[i] = cylinder.half_height;
+    }
+}
+
+static inline SimdFloat dot3(SimdFloat ax, SimdFloat ay, SimdFloat az, SimdFloat bx, SimdFloat by, SimdFloat bz)
+{
+    return simdAdd(simdAdd(simdMul(ax, bx), simdMul(ay, by)), simdMul(az, bz));
+}
+
+// Same interval formulation as Cylinder::intersectCylinder, evaluated for
+// kSimdWidth cylinders starting at slot i. Lanes report the nearest hit inside
+// (t_min, t_max).
+static inline int intersectBatch(const CylinderSoA &soa, int i, const Ray &ray, SimdFloat &t)
+{
+    SimdFloat zero = simdSet(0.0f);
+    SimdFloat eps = simdSet(1e-12f);
+    SimdFloat t_min = simdSet(ray.t_min);
+    SimdFloat t_max = simdSet(ray.t_max);
+
+    SimdFloat ocx = simdSub(simdSet(ray.origin[0]), simdLoad(&soa.cx[i]));
+    SimdFloat ocy = simdSub(simdSet(ray.origin[1]), simdLoad(&soa.cy[i]));
+    SimdFloat ocz = simdSub(simdSet(ray.origin[2]), simdLoad(&soa.cz[i]));
+    SimdFloat dx = simdSet(ray.direction[0]);
+    SimdFloat dy = simdSet(ray.direction[1]);
+    SimdFloat dz = simdSet(ray.direction[2]);
+
+    SimdFloat wx = simdLoad(&soa.wx[i]), wy = simdLoad(&soa.wy[i]), wz = simdLoad(&soa.wz[i]);
+    SimdFloat local_oz = dot3(ocx, ocy, ocz, wx, wy, wz);
+    SimdFloat local_dz = dot3(dx, dy, dz, wx, wy, wz);
+    SimdFloat abs_dz = simdMax(local_dz, simdSub(zero, local_dz));
+    local_dz = simdSelect(simdCmpLt(abs_dz, eps), eps, local_dz);
+
+    SimdFloat hh = simdLoad(&soa.half_height[i]);
+    SimdFloat slab0 = simdDiv(simdSub(simdSub(zero, hh), local_oz), local_dz);
+    SimdFloat slab1 = simdDiv(simdSub(hh, local_oz), local_dz);
+    SimdFloat t_near = simdMin(slab0, slab1);
+    SimdFloat t_far = simdMax(slab0, slab1);
+    // A slab entirely behind the current closest hit can be dropped already.
+    SimdFloat valid = simdAnd(simdAnd(simdCmpGt(t_far, t_min), simdCmpLt(t_near, t_max)), simdCmpGe(hh, zero));
+    if (!simdMask(valid))
+    {
+        return 0;
+    }
+
+    SimdFloat ux = simdLoad(&soa.ux[i]), uy = simdLoad(&soa.uy[i]), uz = simdLoad(&soa.uz[i]);
+    SimdFloat vx = simdLoad(&soa.vx[i]), vy = simdLoad(&soa.vy[i]), vz = simdLoad(&soa.vz[i]);
+    SimdFloat local_ox = dot3(ocx, ocy, ocz, ux, uy, uz);
+    SimdFloat local_oy = dot3(ocx, ocy, ocz, vx, vy, vz);
+    SimdFloat local_dx = dot3(dx, dy, dz, ux, uy, uz);
+    SimdFloat local_dy = dot3(dx, dy, dz, vx, vy, vz);
+
+    SimdFloat a = simdAdd(simdMul(local_dx, local_dx), simdMul(local_dy, local_dy));
+    SimdFloat half_b = simdAdd(simdMul(local_ox, local_dx), simdMul(local_oy, local_dy));
+    SimdFloat c = simdSub(simdAdd(simdMul(local_ox, local_ox), simdMul(local_oy, local_oy)), simdLoad(&soa.r2[i]));
+
+    // Rays parallel to the axis keep the full slab if they start inside the tube.
+    SimdFloat parallel = simdCmpLt(a, eps);
+    SimdFloat safe_a = simdSelect(parallel, simdSet(1.0f), a);
+    SimdFloat discriminant = simdSub(simdMul(half_b, half_b), simdMul(safe_a, c));
+    SimdFloat s = simdSqrt(simdMax(discriminant, zero));
+    SimdFloat side0 = simdDiv(simdSub(simdSub(zero, half_b), s), safe_a);
+    SimdFloat side1 = simdDiv(simdSub(s, half_b), safe_a);
+
+    SimdFloat side_valid = simdSelect(parallel, simdCmpLe(c, zero), simdCmpGe(discriminant, zero));
+    t_near = simdSelect(parallel, t_near, simdMax(t_near, side0));
+    t_far = simdSelect(parallel, t_far, simdMin(t_far, side1));
+
+    valid = simdAnd(valid, side_valid);
+    valid = simdAnd(valid, simdAnd(simdCmpLe(t_near, t_far), simdCmpGt(t_far, t_min)));
+    t = simdSelect(simdCmpGt(t_near, t_min), t_near, t_far);
+    return simdMask(simdAnd(valid, simdCmpLt(t, t_max)));
+}
+
+int CylinderSoA::closestHit(const Ray &ray, int begin, int end, int skip, float &t) const
+{
+    int closest = -1;
+    float closestT = ray.t_max;
+    float lanes[kSimdWidth];
+
+    for (int i = begin; i < end; i += kSimdWidth)
+    {
+        SimdFloat roots;
+        int mask = intersectBatch(*this, i, ray, roots) & simdTailMask(end - i) & simdSkipMask(skip, i);
+        if (!mask)
+        {
+            continue;
+        }
+        simdStore(lanes, roots);
+        for (int lane = 0; lane < kSimdWidth; ++lane)
+        {
+            if ((mask >> lane) & 1 && lanes[lane] < closestT)
+            {
+                closestT = lanes[lane];
+                closest = i + lane;
+            }
+        }
+    }
+
+    if (closest >= 0)
+    {
+        t = closestT;
+    }
+    return closest;
+}
+
+bool CylinderSoA::anyHit(const Ray &ray, int begin, int end, int skip) const
+{
+    for (int i = begin; i < end; i += kSimdWidth)
+    {
+        SimdFloat roots;
+        if (intersectBatch(*this, i, ray, roots) & simdTailMask(end - i) & simdSkipMask(skip, i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
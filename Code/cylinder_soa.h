@@ -0,0 +1,32 @@
+#ifndef CYLINDER_SOA_H
+#define CYLINDER_SOA_H
+
+#include <vector>
+#include "ray.h"
+#include "cylinder.h"
+
+// Structure-of-arrays copy of the cylinder set with each cylinder's local frame,
+// radius^2 and half height, used by the SIMD batch capped-cylinder kernel.
+// cylinder_index maps a slot back to the source cylinder vector.
+class CylinderSoA
+{
+public:
+    void build(const std::vector<Cylinder> &cylinders, const std::vector<int> &order);
+    // Both skip slot skip, the primitive a ray starts on (-1 for none).
+    int closestHit(const Ray &ray, int begin, int end, int skip, float &t) const;
+    bool anyHit(const Ray &ray, int begin, int end, int skip) const;
+    int size() const { return count; }
+
+    std::vector<float> cx, cy, cz;
+    std::vector<float> ux, uy, uz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> wx, wy, wz;
+    std::vector<float> r2;
+    std::vector<float> half_height;
+    std::vector<int> cylinder_index;
+
+private:
+    int count = 0;
+};
+
+#endif
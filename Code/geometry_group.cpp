@@ -0,0 +1,330 @@
+#include "geometry_group.h"
+#include "vector_utils.h"
+
+std::vector<Aabb> GeometryGroup::primitiveBounds() const
+{
+    std::vector<Aabb> primitive_bounds;
+    primitive_bounds.reserve(spheres.size() + cylinders.size() + triangles.size());
+    for (const auto &sphere : spheres)
+    {
+        primitive_bounds.push_back(sphere.bounds());
+    }
+    for (const auto &cylinder : cylinders)
+    {
+        primitive_bounds.push_back(cylinder.bounds());
+    }
+    for (const auto &triangle : triangles)
+    {
+        primitive_bounds.push_back(triangle.bounds());
+    }
+    return primitive_bounds;
+}
+
+void GeometryGroup::commit()
+{
+    bvh.build(primitiveBounds());
+    updateStores();
+    if (compressed)
+    {
+        compress();
+    }
+}
+
+// The compressed layout has dropped the binary nodes, so it rebuilds instead
+// and counts that as one rebuilt subtree.
+int GeometryGroup::refit(float rebuild_threshold)
+{
+    if (compressed)
+    {
+        commit();
+        return 1;
+    }
+    int rebuilt = bvh.refit(primitiveBounds(), rebuild_threshold);
+    updateStores();
+    return rebuilt;
+}
+
+void GeometryGroup::setCompressed(bool enabled)
+{
+    if (enabled == compressed)
+    {
+        return;
+    }
+    if (enabled)
+    {
+        compress();
+        compressed = true;
+    }
+    else
+    {
+        compressed = false;
+        compressed_bvh = CompressedBvh();
+        commit();
+    }
+}
+
+// Leaves keep indexing bvh.indices, so only the binary nodes are freed.
+void GeometryGroup::compress()
+{
+    compressed_bvh.build(bvh);
+    bvh.nodes.clear();
+    bvh.nodes.shrink_to_fit();
+}
+
+size_t GeometryGroup::nodeBytes() const
+{
+    return compressed_bvh.memoryBytes() + bvh.nodes.size() * sizeof(BvhNode);
+}
+
+void GeometryGroup::updateStores()
+{
+    int sphere_count = static_cast<int>(spheres.size());
+    int cylinder_count = static_cast<int>(cylinders.size());
+
+    std::vector<int> sphere_order;
+    std::vector<int> cylinder_order;
+    sphere_prefix.assign(bvh.indices.size() + 1, 0);
+    cylinder_prefix.assign(bvh.indices.size() + 1, 0);
+    store_slot.assign(sphere_count + cylinder_count, -1);
+    for (size_t i = 0; i < bvh.indices.size(); ++i)
+    {
+        int id = bvh.indices[i];
+        if (id < sphere_count)
+        {
+            store_slot[id] = static_cast<int>(sphere_order.size());
+            sphere_order.push_back(id);
+        }
+        else if (id < sphere_count + cylinder_count)
+        {
+            store_slot[id] = static_cast<int>(cylinder_order.size());
+            cylinder_order.push_back(id - sphere_count);
+        }
+        sphere_prefix[i + 1] = static_cast<int>(sphere_order.size());
+        cylinder_prefix[i + 1] = static_cast<int>(cylinder_order.size());
+    }
+    sphere_store.build(spheres, sphere_order);
+    cylinder_store.build(cylinders, cylinder_order);
+    root_bounds = bvh.empty() ? Aabb() : bvh.nodes[0].bounds;
+}
+
+int GeometryGroup::primitiveId(const HitRecord &hit) const
+{
+    switch (hit.kind)
+    {
+    case PrimitiveKind::Sphere:
+        return hit.primitive;
+    case PrimitiveKind::Cylinder:
+        return static_cast<int>(spheres.size()) + hit.primitive;
+    default:
+        return static_cast<int>(spheres.size() + cylinders.size()) + hit.primitive;
+    }
+}
+
+// Translates the ray's excluded primitive into a sphere slot, cylinder slot
+// or triangle index; the other two stay -1.
+void GeometryGroup::skipSlots(int exclude_primitive, int &sphere_skip, int &cylinder_skip, int &triangle_skip) const
+{
+    int id = exclude_primitive;
+    int sphere_count = static_cast<int>(spheres.size());
+    int triangle_base = static_cast<int>(spheres.size() + cylinders.size());
+    sphere_skip = id >= 0 && id < sphere_count ? store_slot[id] : -1;
+    cylinder_skip = id >= sphere_count && id < triangle_base ? store_slot[id] : -1;
+    triangle_skip = id >= triangle_base ? id - triangle_base : -1;
+}
+
+bool GeometryGroup::intersect(Ray &ray, HitRecord &hit) const
+{
+    int triangle_base = static_cast<int>(spheres.size() + cylinders.size());
+    bool found = false;
+    int sphere_skip, cylinder_skip, triangle_skip;
+    skipSlots(ray.exclude_primitive, sphere_skip, cylinder_skip, triangle_skip);
+
+    // Every kernel only reports hits in front of ray.t_max, so a hit found
+    // here is always the closest so far.
+    auto visit = [&](int first, int count) {
+        int last = first + count;
+        float t;
+
+        int slot = sphere_store.closestHit(ray, sphere_prefix[first], sphere_prefix[last], sphere_skip, t);
+        if (slot >= 0)
+        {
+            ray.t_max = t;
+            hit.kind = PrimitiveKind::Sphere;
+            hit.primitive = sphere_store.sphere_index[slot];
+            found = true;
+        }
+
+        slot = cylinder_store.closestHit(ray, cylinder_prefix[first], cylinder_prefix[last], cylinder_skip, t);
+        if (slot >= 0)
+        {
+            ray.t_max = t;
+            hit.kind = PrimitiveKind::Cylinder;
+            hit.primitive = cylinder_store.cylinder_index[slot];
+            found = true;
+        }
+
+        int triangle_begin = first + (sphere_prefix[last] - sphere_prefix[first]) + (cylinder_prefix[last] - cylinder_prefix[first]);
+        for (int i = triangle_begin; i < last; ++i)
+        {
+            int index = bvh.indices[i] - triangle_base;
+            if (index != triangle_skip && triangles[index].intersectTriangle(ray, t))
+            {
+                ray.t_max = t;
+                hit.kind = PrimitiveKind::Triangle;
+                hit.primitive = index;
+                found = true;
+            }
+        }
+        return false;
+    };
+    if (compressed)
+    {
+        compressed_bvh.traverse(ray, visit);
+    }
+    else
+    {
+        bvh.traverse(ray, [&](const BvhNode &leaf) { return visit(leaf.left_first, leaf.count); });
+    }
+
+    if (found)
+    {
+        hit.t = ray.t_max;
+    }
+    return found;
+}
+
+bool GeometryGroup::leafOccludes(const Ray &ray, int first, int count, int sphere_skip, int cylinder_skip, int triangle_skip) const
+{
+    int last = first + count;
+    if (sphere_store.anyHit(ray, sphere_prefix[first], sphere_prefix[last], sphere_skip) ||
+        cylinder_store.anyHit(ray, cylinder_prefix[first], cylinder_prefix[last], cylinder_skip))
+    {
+        return true;
+    }
+
+    int triangle_base = static_cast<int>(spheres.size() + cylinders.size());
+    int triangle_begin = first + (sphere_prefix[last] - sphere_prefix[first]) + (cylinder_prefix[last] - cylinder_prefix[first]);
+    float t;
+    for (int i = triangle_begin; i < last; ++i)
+    {
+        int index = bvh.indices[i] - triangle_base;
+        if (index != triangle_skip && triangles[index].intersectTriangle(ray, t))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GeometryGroup::occluded(const Ray &ray) const
+{
+    bool blocked = false;
+    Ray query = ray;
+    int sphere_skip, cylinder_skip, triangle_skip;
+    skipSlots(ray.exclude_primitive, sphere_skip, cylinder_skip, triangle_skip);
+
+    auto visit = [&](int first, int count) {
+        blocked = leafOccludes(query, first, count, sphere_skip, cylinder_skip, triangle_skip);
+        return blocked;
+    };
+    if (compressed)
+    {
+        compressed_bvh.traverse(query, visit);
+    }
+    else
+    {
+        bvh.traverse(query, [&](const BvhNode &leaf) { return visit(leaf.left_first, leaf.count); });
+    }
+
+    return blocked;
+}
+
+// Packets only traverse the binary layout; with compressed nodes each ray
+// takes the single-ray path.
+uint64_t GeometryGroup::occluded(const RayPacket &packet, uint64_t active, const int *exclude) const
+{
+    uint64_t blocked = 0;
+    if (compressed)
+    {
+        for (int i = 0; i < packet.count; ++i)
+        {
+            if (active >> i & 1)
+            {
+                Ray query = packet.rays[i];
+                query.exclude_primitive = exclude[i];
+                blocked |= static_cast<uint64_t>(occluded(query)) << i;
+            }
+        }
+        return blocked;
+    }
+
+    int skips[RayPacket::kMaxRays][3];
+    for (int i = 0; i < packet.count; ++i)
+    {
+        skipSlots(exclude[i], skips[i][0], skips[i][1], skips[i][2]);
+    }
+    bvh.traversePacket(packet, active, [&](const BvhNode &leaf, uint64_t mask) {
+        uint64_t answered = 0;
+        for (int i = 0; i < packet.count; ++i)
+        {
+            if ((mask >> i & 1) && leafOccludes(packet.rays[i], leaf.left_first, leaf.count, skips[i][0], skips[i][1], skips[i][2]))
+            {
+                answered |= uint64_t(1) << i;
+            }
+        }
+        blocked |= answered;
+        return answered;
+    });
+    return blocked;
+}
+
+Vec3 GeometryGroup::normalAt(const HitRecord &hit, const Vec3 &point) const
+{
+    Vec3 normal;
+    if (hit.kind == PrimitiveKind::Sphere)
+    {
+        const Sphere &sphere = spheres[hit.primitive];
+        normal = {point[0] - sphere.center[0],
+                  point[1] - sphere.center[1],
+                  point[2] - sphere.center[2]};
+        normalize(normal);
+    }
+    else if (hit.kind == PrimitiveKind::Cylinder)
+    {
+        // Side or cap normal depending on which surface was hit
+        normal = cylinders[hit.primitive].normalAt(point);
+    }
+    else
+    {
+        const Triangle &triangle = triangles[hit.primitive];
+        float edge1[3] = {triangle.v1[0] - triangle.v0[0],
+                          triangle.v1[1] - triangle.v0[1],
+                          triangle.v1[2] - triangle.v0[2]};
+        float edge2[3] = {triangle.v2[0] - triangle.v0[0],
+                          triangle.v2[1] - triangle.v0[1],
+                          triangle.v2[2] - triangle.v0[2]};
+        normal = {edge1[1] * edge2[2] - edge1[2] * edge2[1],
+                  edge1[2] * edge2[0] - edge1[0] * edge2[2],
+                  edge1[0] * edge2[1] - edge1[1] * edge2[0]};
+        normalize(normal);
+    }
+    return normal;
+}
+
+const Material &GeometryGroup::materialOf(const HitRecord &hit) const
+{
+    if (hit.kind == PrimitiveKind::Sphere)
+    {
+        return spheres[hit.primitive].material;
+    }
+    if (hit.kind == PrimitiveKind::Cylinder)
+    {
+        return cylinders[hit.primitive].material;
+    }
+    return triangles[hit.primitive].material;
+}
+
+Aabb GeometryGroup::bounds() const
+{
+    return root_bounds;
+}
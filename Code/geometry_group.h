@@ -0,0 +1,78 @@
+#ifndef GEOMETRY_GROUP_H
+#define GEOMETRY_GROUP_H
+
+#include <vector>
+#include "ray.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+#include "cylinder.h"
+#include "cylinder_soa.h"
+#include "triangle.h"
+#include "material.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "ray_packet.h"
+#include "compressed_bvh.h"
+#include "hit_record.h"
+
+// A set of shapes with its own bottom-level BVH. The scene's own shapes live in
+// one group, and every instanced asset is a group shared by all its instances.
+class GeometryGroup
+{
+public:
+    void commit();
+    // Call after moving shapes in place (same counts). Keeps the BVH topology
+    // unless a subtree degraded past rebuild_threshold; see Bvh::refit.
+    int refit(float rebuild_threshold);
+    // Closest hit within the ray's interval; shrinks ray.t_max to its distance.
+    // Both queries skip the primitive named by ray.exclude_primitive.
+    bool intersect(Ray &ray, HitRecord &hit) const;
+    bool occluded(const Ray &ray) const;
+    // Any-hit for the rays of active, traced as one packet. Bit i of the
+    // result is set when rays[i] is blocked; exclude[i] takes the place of
+    // its exclude_primitive.
+    uint64_t occluded(const RayPacket &packet, uint64_t active, const int *exclude) const;
+    // The hit primitive's id in the BVH id space, as Ray::exclude_primitive
+    // expects it.
+    int primitiveId(const HitRecord &hit) const;
+    Vec3 normalAt(const HitRecord &hit, const Vec3 &point) const;
+    const Material &materialOf(const HitRecord &hit) const;
+    Aabb bounds() const;
+    // Traverses a quantized 4-wide copy of the BVH instead of the binary
+    // one, whose nodes are then freed; refit and switching back rebuild them.
+    void setCompressed(bool enabled);
+    bool isCompressed() const { return compressed; }
+    // Bytes of BVH nodes held, in whichever layout is resident.
+    size_t nodeBytes() const;
+
+    std::vector<Sphere> spheres;
+    std::vector<Cylinder> cylinders;
+    std::vector<Triangle> triangles;
+
+private:
+    std::vector<Aabb> primitiveBounds() const;
+    void updateStores();
+    void compress();
+    void skipSlots(int exclude_primitive, int &sphere_skip, int &cylinder_skip, int &triangle_skip) const;
+    // Whether a primitive of the leaf holding bvh.indices[first, first + count) blocks ray.
+    bool leafOccludes(const Ray &ray, int first, int count, int sphere_skip, int cylinder_skip, int triangle_skip) const;
+
+    // The BVH works on one id space: spheres first, then cylinders, then
+    // triangles. The SoA stores are filled in BVH order, so the spheres and
+    // cylinders of a leaf are contiguous slot ranges found via these prefix
+    // counts over bvh.indices.
+    Bvh bvh;
+    SphereSoA sphere_store;
+    CylinderSoA cylinder_store;
+    std::vector<int> sphere_prefix;
+    std::vector<int> cylinder_prefix;
+    // SoA slot of every sphere and cylinder id.
+    std::vector<int> store_slot;
+
+    bool compressed = false;
+    CompressedBvh compressed_bvh;
+    // Box of all primitives, kept apart from the nodes that may be freed.
+    Aabb root_bounds;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HIT_RECORD_H
+#define HIT_RECORD_H
+
+#include <limits>
+
+enum class PrimitiveKind
+{
+    Sphere,
+    Cylinder,
+    Triangle
+};
+
+// Closest hit found so far. instance is -1 for shapes placed directly in the
+// scene; otherwise primitive indexes the instanced group's shape vectors.
+struct HitRecord
+{
+    float t = std::numeric_limits<float>::max();
+    PrimitiveKind kind = PrimitiveKind::Sphere;
+    int primitive = -1;
+    int instance = -1;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef IMAGE_REGION_H
+#define IMAGE_REGION_H
+
+#include <algorithm>
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1).
+struct ImageRegion
+{
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+};
+
+inline ImageRegion clipRegion(const ImageRegion &region, int width, int height)
+{
+    return {std::max(region.x0, 0), std::max(region.y0, 0), std::min(region.x1, width), std::min(region.y1, height)};
+}
+
+// Tiles are tile_size squares numbered row-major; edge tiles are clipped.
+inline int tileCount(int width, int height, int tile_size)
+{
+    return ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+}
+
+inline ImageRegion tileRegion(int width, int height, int tile_size, int tile)
+{
+    int columns = (width + tile_size - 1) / tile_size;
+    int x0 = (tile % columns) * tile_size;
+    int y0 = (tile / columns) * tile_size;
+    return clipRegion({x0, y0, x0 + tile_size, y0 + tile_size}, width, height);
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include "instance.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+Instance::Instance(int group, const float transform[12])
+    : group(group), has_material(false)
+{
+    setTransform(transform);
+}
+
+void Instance::setTransform(const float transform[12])
+{
+    for (int i = 0; i < 12; ++i)
+    {
+        object_to_world[i] = transform[i];
+    }
+    if (!invertTransform(object_to_world, world_to_object))
+    {
+        throw std::runtime_error("Instance transform is not invertible");
+    }
+}
+
+void Instance::updateBounds(const Aabb &object_bounds)
+{
+    bounds = Aabb();
+    if (object_bounds.empty())
+    {
+        return;
+    }
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        float point[3] = {(corner & 1) ? object_bounds.max[0] : object_bounds.min[0],
+                          (corner & 2) ? object_bounds.max[1] : object_bounds.min[1],
+                          (corner & 4) ? object_bounds.max[2] : object_bounds.min[2]};
+        float world[3];
+        transformPoint(object_to_world, point, world);
+        bounds.expand(world);
+    }
+}
+
+void transformPoint(const float m[12], const float in[3], float out[3])
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        out[row] = m[row * 4] * in[0] + m[row * 4 + 1] * in[1] + m[row * 4 + 2] * in[2] + m[row * 4 + 3];
+    }
+}
+
+void transformVector(const float m[12], const float in[3], float out[3])
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        out[row] = m[row * 4] * in[0] + m[row * 4 + 1] * in[1] + m[row * 4 + 2] * in[2];
+    }
+}
+
+// Normals go through the inverse transpose, so this takes world_to_object.
+void transformNormal(const float inverse[12], const float in[3], float out[3])
+{
+    for (int col = 0; col < 3; ++col)
+    {
+        out[col] = inverse[col] * in[0] + inverse[4 + col] * in[1] + inverse[8 + col] * in[2];
+    }
+}
+
+void multiplyTransforms(const float a[12], const float b[12], float out[12])
+{
+    float result[12];
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int col = 0; col < 4; ++col)
+        {
+            float value = a[row * 4] * b[col] + a[row * 4 + 1] * b[4 + col] + a[row * 4 + 2] * b[8 + col];
+            if (col == 3)
+            {
+                value += a[row * 4 + 3];
+            }
+            result[row * 4 + col] = value;
+        }
+    }
+    for (int i = 0; i < 12; ++i)
+    {
+        out[i] = result[i];
+    }
+}
+
+void composeTransform(const float translate[3], const float rotate[3], const float scale[3], float out[12])
+{
+    const float pi = 3.14159265358979323846f;
+    float transform[12] = {scale[0], 0, 0, 0, 0, scale[1], 0, 0, 0, 0, scale[2], 0};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float angle = rotate[axis] * pi / 180.0f;
+        float c = std::cos(angle), s = std::sin(angle);
+        float rotation[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+        int a = (axis + 1) % 3, b = (axis + 2) % 3;
+        rotation[a * 4 + a] = c;
+        rotation[a * 4 + b] = -s;
+        rotation[b * 4 + a] = s;
+        rotation[b * 4 + b] = c;
+        multiplyTransforms(rotation, transform, transform);
+    }
+    transform[3] += translate[0];
+    transform[7] += translate[1];
+    transform[11] += translate[2];
+    std::copy(transform, transform + 12, out);
+}
+
+bool invertTransform(const float m[12], float out[12])
+{
+    float a = m[0], b = m[1], c = m[2];
+    float d = m[4], e = m[5], f = m[6];
+    float g = m[8], h = m[9], k = m[10];
+
+    float det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+    if (std::fabs(det) < 1e-12f)
+    {
+        return false;
+    }
+    float inv_det = 1.0f / det;
+
+    float r[9] = {(e * k - f * h) * inv_det, (c * h - b * k) * inv_det, (b * f - c * e) * inv_det,
+                  (f * g - d * k) * inv_det, (a * k - c * g) * inv_det, (c * d - a * f) * inv_det,
+                  (d * h - e * g) * inv_det, (b * g - a * h) * inv_det, (a * e - b * d) * inv_det};
+
+    for (int row = 0; row < 3; ++row)
+    {
+        out[row * 4] = r[row * 3];
+        out[row * 4 + 1] = r[row * 3 + 1];
+        out[row * 4 + 2] = r[row * 3 + 2];
+        out[row * 4 + 3] = -(r[row * 3] * m[3] + r[row * 3 + 1] * m[7] + r[row * 3 + 2] * m[11]);
+    }
+    return true;
+}
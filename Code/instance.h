@@ -0,0 +1,34 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <vector>
+#include "material.h"
+#include "aabb.h"
+
+// One placed copy of a shared geometry group. Transforms are affine 3x4
+// row-major matrices; the inverse is cached because every ray entering the
+// instance is carried into object space.
+struct Instance
+{
+    int group;
+    float object_to_world[12];
+    float world_to_object[12];
+    bool has_material;
+    Material material;
+    Aabb bounds;
+
+    Instance(int group, const float transform[12]);
+    // Throws if transform is singular.
+    void setTransform(const float transform[12]);
+    void updateBounds(const Aabb &object_bounds);
+};
+
+void transformPoint(const float m[12], const float in[3], float out[3]);
+void transformVector(const float m[12], const float in[3], float out[3]);
+void transformNormal(const float inverse[12], const float in[3], float out[3]);
+void multiplyTransforms(const float a[12], const float b[12], float out[12]);
+bool invertTransform(const float m[12], float out[12]);
+// T * Rz * Ry * Rx * S, with rotations in degrees about x, y and z.
+void composeTransform(const float translate[3], const float rotate[3], const float scale[3], float out[12]);
+
+#endif
@@ -1,7 +1,39 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <cstdint>
 #include <vector>
+#include "specular_power.h"
+
+// Shading paths a material is sorted into when it is loaded. Each kernel only
+// evaluates the terms that can reach the pixel: a refractive material's
+// Blinn-Phong weight is exactly zero, and so is a perfect mirror's.
+enum class ShadingKernel : uint8_t
+{
+    Diffuse,          // Blinn-Phong without a highlight
+    Specular,         // Blinn-Phong
+    Glossy,           // Blinn-Phong blended with a partial reflection
+    Mirror,           // reflection only
+    Glass,            // refraction only
+    ReflectiveGlass   // refraction blended with reflection
+};
+
+// Which terms each kernel evaluates; specialized per kernel.
+template <ShadingKernel kernel>
+struct KernelTraits;
+
+template <>
+struct KernelTraits<ShadingKernel::Diffuse> { static constexpr bool phong = true, specular = false, reflect = false, refract = false; };
+template <>
+struct KernelTraits<ShadingKernel::Specular> { static constexpr bool phong = true, specular = true, reflect = false, refract = false; };
+template <>
+struct KernelTraits<ShadingKernel::Glossy> { static constexpr bool phong = true, specular = true, reflect = true, refract = false; };
+template <>
+struct KernelTraits<ShadingKernel::Mirror> { static constexpr bool phong = false, specular = false, reflect = true, refract = false; };
+template <>
+struct KernelTraits<ShadingKernel::Glass> { static constexpr bool phong = false, specular = false, reflect = false, refract = true; };
+template <>
+struct KernelTraits<ShadingKernel::ReflectiveGlass> { static constexpr bool phong = false, specular = false, reflect = true, refract = true; };
 
 struct Material
 {
@@ -14,11 +46,35 @@ struct Material
     float reflectivity;
     bool is_refractive;
     float refractive_index;
+    // Set from the fields above on construction.
+    ShadingKernel kernel;
+    // pow(x, specular_exponent); only built for kernels with a highlight.
+    SpecularPower specular_power;
+    // Order of the material in the scene file, for the material id output;
+    // -1 when it was not loaded from one.
+    int id = -1;
 
-    Material() : ks_coeffcient(0.0f), kd_coeffcient(0.0f), specular_exponent(0.0f), diffuse_color({0.0f, 0.0f, 0.0f}), specular_color({0.0f, 0.0f, 0.0f}), is_reflective(false), reflectivity(0.0f), is_refractive(false), refractive_index(0.0f) {}
+    Material() : ks_coeffcient(0.0f), kd_coeffcient(0.0f), specular_exponent(0.0f), diffuse_color({0.0f, 0.0f, 0.0f}), specular_color({0.0f, 0.0f, 0.0f}), is_reflective(false), reflectivity(0.0f), is_refractive(false), refractive_index(0.0f), kernel(ShadingKernel::Diffuse) {}
 
     Material(float ks_coeffcient, float kd_coeffcient, float specular_exponent, std::vector<float> diffuse_color, std::vector<float> specular_color, bool is_reflective, float reflectivity, bool is_refractive, float refractive_index)
-        : ks_coeffcient(ks_coeffcient), kd_coeffcient(kd_coeffcient), specular_exponent(specular_exponent), diffuse_color(diffuse_color), specular_color(specular_color), is_reflective(is_reflective), reflectivity(reflectivity), is_refractive(is_refractive), refractive_index(refractive_index) {}
+        : ks_coeffcient(ks_coeffcient), kd_coeffcient(kd_coeffcient), specular_exponent(specular_exponent), diffuse_color(diffuse_color), specular_color(specular_color), is_reflective(is_reflective), reflectivity(reflectivity), is_refractive(is_refractive), refractive_index(refractive_index), kernel(classify()),
+          specular_power(kernel == ShadingKernel::Specular || kernel == ShadingKernel::Glossy ? SpecularPower(specular_exponent) : SpecularPower()) {}
+
+    // The kernel that gives the same color as shading with every term.
+    ShadingKernel classify() const
+    {
+        if (is_refractive)
+        {
+            return is_reflective ? ShadingKernel::ReflectiveGlass : ShadingKernel::Glass;
+        }
+        if (is_reflective)
+        {
+            return reflectivity == 1.0f ? ShadingKernel::Mirror : ShadingKernel::Glossy;
+        }
+        // A negative exponent would make the zero highlight infinite at grazing angles.
+        bool no_highlight = ks_coeffcient == 0.0f || (specular_color[0] == 0.0f && specular_color[1] == 0.0f && specular_color[2] == 0.0f);
+        return no_highlight && specular_exponent >= 0.0f ? ShadingKernel::Diffuse : ShadingKernel::Specular;
+    }
 };
 
 #endif
\ No newline at end of file
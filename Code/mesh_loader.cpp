@@ -0,0 +1,590 @@
+#include "mesh_loader.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+int workerCount(size_t work)
+{
+    int threads = ThreadPool::shared().size() + 1;
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(threads, work)));
+}
+
+// Runs fn(chunk, begin, end) over count items split into the given number of
+// ranges on the shared pool. An exception from any chunk, such as a parse
+// error, is rethrown on the calling thread once every chunk has finished.
+template <typename Fn>
+void parallelChunks(size_t count, int chunks, Fn fn)
+{
+    std::vector<std::exception_ptr> errors(chunks);
+    auto runChunk = [&](int chunk, size_t begin, size_t end) {
+        try
+        {
+            fn(chunk, begin, end);
+        }
+        catch (...)
+        {
+            errors[chunk] = std::current_exception();
+        }
+    };
+
+    TaskGroup group(ThreadPool::shared());
+    for (int chunk = 1; chunk < chunks; ++chunk)
+    {
+        size_t begin = count * chunk / chunks;
+        size_t end = count * (chunk + 1) / chunks;
+        group.run([=, &runChunk] { runChunk(chunk, begin, end); });
+    }
+    runChunk(0, 0, count / chunks);
+    group.wait();
+    for (const std::exception_ptr &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open mesh file " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not stat mesh file " + path);
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size > 0)
+        {
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Could not map mesh file " + path);
+            }
+            data = static_cast<const char *>(mapping);
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+        {
+            munmap(const_cast<char *>(data), size);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data = nullptr;
+    size_t size = 0;
+};
+
+// Builds the Triangle objects on all threads and appends them in face order.
+void buildTriangles(const std::vector<float> &vertices, const std::vector<int> &faces, const Material &material, std::vector<Triangle> &triangles)
+{
+    size_t vertex_count = vertices.size() / 3;
+    for (int index : faces)
+    {
+        if (index < 0 || static_cast<size_t>(index) >= vertex_count)
+        {
+            throw std::runtime_error("Mesh face references a missing vertex");
+        }
+    }
+
+    size_t face_count = faces.size() / 3;
+    int chunks = workerCount(face_count / 4096 + 1);
+    std::vector<std::vector<Triangle>> built(chunks);
+    parallelChunks(face_count, chunks, [&](int chunk, size_t begin, size_t end) {
+        std::vector<Triangle> &out = built[chunk];
+        out.reserve(end - begin);
+        for (size_t f = begin; f < end; ++f)
+        {
+            const float *a = &vertices[3 * faces[3 * f]];
+            const float *b = &vertices[3 * faces[3 * f + 1]];
+            const float *c = &vertices[3 * faces[3 * f + 2]];
+            out.emplace_back(std::vector<float>(a, a + 3), std::vector<float>(b, b + 3), std::vector<float>(c, c + 3), material);
+        }
+    });
+
+    triangles.reserve(triangles.size() + face_count);
+    for (auto &part : built)
+    {
+        triangles.insert(triangles.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
+}
+
+// Per-chunk OBJ parse result. Negative (relative) face indices cannot be
+// resolved until the vertex counts of earlier chunks are known, so they are
+// stored relative to the chunk and flagged in relative_faces.
+struct ObjChunk
+{
+    std::vector<float> vertices;
+    std::vector<int> faces;
+    std::vector<bool> relative_faces;
+};
+
+const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+void parseObjChunk(const char *p, const char *end, ObjChunk &chunk)
+{
+    std::vector<int> polygon;
+    std::vector<bool> polygon_relative;
+    while (p < end)
+    {
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!line_end)
+        {
+            line_end = end;
+        }
+        p = skipSpaces(p, line_end);
+
+        if (line_end - p > 1 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            // strtof skips newlines too, so each coordinate must both parse
+            // and end on this line.
+            const char *cursor = p + 1;
+            for (int i = 0; i < 3; ++i)
+            {
+                char *next;
+                float coordinate = strtof(cursor, &next);
+                if (next == cursor || next > line_end)
+                {
+                    throw std::runtime_error("Malformed OBJ vertex");
+                }
+                chunk.vertices.push_back(coordinate);
+                cursor = next;
+            }
+        }
+        else if (line_end - p > 1 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            polygon.clear();
+            polygon_relative.clear();
+            const char *cursor = p + 1;
+            int local_vertices = static_cast<int>(chunk.vertices.size() / 3);
+            while (true)
+            {
+                cursor = skipSpaces(cursor, line_end);
+                if (cursor >= line_end || *cursor == '\r')
+                {
+                    break;
+                }
+                char *next;
+                long index = strtol(cursor, &next, 10);
+                if (next == cursor)
+                {
+                    throw std::runtime_error("Malformed OBJ face");
+                }
+                // Skip texture/normal references ("v/vt/vn").
+                cursor = next;
+                while (cursor < line_end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+                {
+                    ++cursor;
+                }
+                if (index < 0)
+                {
+                    polygon.push_back(local_vertices + static_cast<int>(index));
+                    polygon_relative.push_back(true);
+                }
+                else
+                {
+                    polygon.push_back(static_cast<int>(index) - 1);
+                    polygon_relative.push_back(false);
+                }
+            }
+            for (size_t i = 1; i + 1 < polygon.size(); ++i)
+            {
+                for (size_t corner : {size_t(0), i, i + 1})
+                {
+                    chunk.faces.push_back(polygon[corner]);
+                    chunk.relative_faces.push_back(polygon_relative[corner]);
+                }
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+enum PlyType
+{
+    PlyInt8,
+    PlyUint8,
+    PlyInt16,
+    PlyUint16,
+    PlyInt32,
+    PlyUint32,
+    PlyFloat32,
+    PlyFloat64
+};
+
+PlyType plyType(const std::string &name)
+{
+    if (name == "char" || name == "int8") return PlyInt8;
+    if (name == "uchar" || name == "uint8") return PlyUint8;
+    if (name == "short" || name == "int16") return PlyInt16;
+    if (name == "ushort" || name == "uint16") return PlyUint16;
+    if (name == "int" || name == "int32") return PlyInt32;
+    if (name == "uint" || name == "uint32") return PlyUint32;
+    if (name == "float" || name == "float32") return PlyFloat32;
+    if (name == "double" || name == "float64") return PlyFloat64;
+    throw std::runtime_error("Unsupported PLY property type " + name);
+}
+
+int plyTypeSize(PlyType type)
+{
+    static const int sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+    return sizes[type];
+}
+
+double readPlyValue(const char *p, PlyType type, bool swap)
+{
+    unsigned char bytes[8];
+    int size = plyTypeSize(type);
+    memcpy(bytes, p, size);
+    if (swap)
+    {
+        std::reverse(bytes, bytes + size);
+    }
+    switch (type)
+    {
+    case PlyInt8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+    case PlyUint8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+    case PlyInt16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+    case PlyUint16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+    case PlyInt32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+    case PlyUint32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+    case PlyFloat32: { float v; memcpy(&v, bytes, 4); return v; }
+    case PlyFloat64: break;
+    }
+    double v;
+    memcpy(&v, bytes, 8);
+    return v;
+}
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type = PlyFloat32;
+    bool is_list = false;
+    PlyType count_type = PlyUint8;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+} // namespace
+
+void MeshLoader::load(const std::string &path, const Material &material, std::vector<Triangle> &triangles)
+{
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == "obj")
+    {
+        loadObj(path, material, triangles);
+    }
+    else if (extension == "ply")
+    {
+        loadPly(path, material, triangles);
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported mesh format: " + path);
+    }
+}
+
+void MeshLoader::loadObj(const std::string &path, const Material &material, std::vector<Triangle> &triangles)
+{
+    // Read into a string rather than mapping it: strtof/strtol need the
+    // terminating null when the last line has no newline.
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream)
+    {
+        throw std::runtime_error("Could not open mesh file " + path);
+    }
+    std::string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    const char *begin = contents.data();
+    const char *end = begin + contents.size();
+
+    // Cut the file into line-aligned blocks, one per thread.
+    int chunks = workerCount(contents.size() / (1 << 20) + 1);
+    std::vector<const char *> bounds(chunks + 1, end);
+    bounds[0] = begin;
+    for (int i = 1; i < chunks; ++i)
+    {
+        const char *guess = std::max(bounds[i - 1], begin + contents.size() * i / chunks);
+        const char *newline = static_cast<const char *>(memchr(guess, '\n', end - guess));
+        bounds[i] = newline ? newline + 1 : end;
+    }
+
+    std::vector<ObjChunk> parsed(chunks);
+    parallelChunks(chunks, chunks, [&](int chunk, size_t, size_t) {
+        parseObjChunk(bounds[chunk], bounds[chunk + 1], parsed[chunk]);
+    });
+
+    std::vector<int> vertex_offsets(chunks + 1, 0);
+    for (int i = 0; i < chunks; ++i)
+    {
+        vertex_offsets[i + 1] = vertex_offsets[i] + static_cast<int>(parsed[i].vertices.size() / 3);
+    }
+
+    std::vector<float> vertices;
+    std::vector<int> faces;
+    vertices.reserve(3 * static_cast<size_t>(vertex_offsets[chunks]));
+    for (int i = 0; i < chunks; ++i)
+    {
+        vertices.insert(vertices.end(), parsed[i].vertices.begin(), parsed[i].vertices.end());
+        for (size_t f = 0; f < parsed[i].faces.size(); ++f)
+        {
+            faces.push_back(parsed[i].relative_faces[f] ? parsed[i].faces[f] + vertex_offsets[i] : parsed[i].faces[f]);
+        }
+        parsed[i] = ObjChunk();
+    }
+
+    buildTriangles(vertices, faces, material, triangles);
+}
+
+void MeshLoader::loadPly(const std::string &path, const Material &material, std::vector<Triangle> &triangles)
+{
+    MappedFile file(path);
+    const char *end = file.data + file.size;
+    const char *marker = "end_header";
+    const char *header_end = std::search(file.data, end, marker, marker + strlen(marker));
+    if (file.size < 3 || strncmp(file.data, "ply", 3) != 0 || header_end == end)
+    {
+        throw std::runtime_error("Not a PLY file: " + path);
+    }
+    const char *body = static_cast<const char *>(memchr(header_end, '\n', end - header_end));
+    if (!body)
+    {
+        throw std::runtime_error("Truncated PLY header: " + path);
+    }
+    ++body;
+
+    bool swap = false;
+    std::vector<PlyElement> elements;
+    std::istringstream header(std::string(file.data, header_end));
+    std::string line;
+    while (std::getline(header, line))
+    {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+        if (keyword == "format")
+        {
+            std::string format;
+            words >> format;
+            if (format == "binary_big_endian")
+            {
+                swap = true;
+            }
+            else if (format != "binary_little_endian")
+            {
+                throw std::runtime_error("Only binary PLY files are supported: " + path);
+            }
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            if (type == "list")
+            {
+                property.is_list = true;
+                words >> type;
+                property.count_type = plyType(type);
+                words >> type;
+            }
+            property.type = plyType(type);
+            words >> property.name;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    std::vector<float> vertices;
+    std::vector<int> faces;
+    const char *cursor = body;
+
+    for (const auto &element : elements)
+    {
+        bool has_list = false;
+        size_t stride = 0;
+        for (const auto &property : element.properties)
+        {
+            has_list = has_list || property.is_list;
+            if (!property.is_list)
+            {
+                stride += plyTypeSize(property.type);
+            }
+        }
+
+        if (element.name == "vertex" && !has_list)
+        {
+            int offsets[3] = {-1, -1, -1};
+            PlyType types[3] = {PlyFloat32, PlyFloat32, PlyFloat32};
+            size_t offset = 0;
+            for (const auto &property : element.properties)
+            {
+                int axis = property.name == "x" ? 0 : property.name == "y" ? 1 : property.name == "z" ? 2 : -1;
+                if (axis >= 0)
+                {
+                    offsets[axis] = static_cast<int>(offset);
+                    types[axis] = property.type;
+                }
+                offset += plyTypeSize(property.type);
+            }
+            if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0 || cursor + stride * element.count > end)
+            {
+                throw std::runtime_error("Invalid PLY vertex data: " + path);
+            }
+
+            // Fixed stride: every thread decodes its own vertex range.
+            vertices.resize(3 * element.count);
+            parallelChunks(element.count, workerCount(element.count / 65536 + 1), [&](int, size_t begin, size_t last) {
+                for (size_t i = begin; i < last; ++i)
+                {
+                    const char *record = cursor + i * stride;
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        vertices[3 * i + axis] = static_cast<float>(readPlyValue(record + offsets[axis], types[axis], swap));
+                    }
+                }
+            });
+            cursor += stride * element.count;
+        }
+        else if (element.name == "face")
+        {
+            // Lists make records variable-sized: find every record start with a
+            // cheap serial scan, then decode the faces in parallel.
+            std::vector<const char *> records(element.count);
+            std::vector<size_t> first_triangle(element.count + 1, 0);
+            int list_property = -1;
+            for (size_t p = 0; p < element.properties.size(); ++p)
+            {
+                if (element.properties[p].is_list && (element.properties[p].name == "vertex_indices" || element.properties[p].name == "vertex_index"))
+                {
+                    list_property = static_cast<int>(p);
+                }
+            }
+            if (list_property < 0)
+            {
+                throw std::runtime_error("PLY face element has no vertex_indices list: " + path);
+            }
+
+            for (size_t i = 0; i < element.count; ++i)
+            {
+                records[i] = cursor;
+                for (size_t p = 0; p < element.properties.size(); ++p)
+                {
+                    const PlyProperty &property = element.properties[p];
+                    if (cursor >= end)
+                    {
+                        throw std::runtime_error("Truncated PLY face data: " + path);
+                    }
+                    if (!property.is_list)
+                    {
+                        cursor += plyTypeSize(property.type);
+                        continue;
+                    }
+                    size_t n = static_cast<size_t>(readPlyValue(cursor, property.count_type, swap));
+                    cursor += plyTypeSize(property.count_type) + n * plyTypeSize(property.type);
+                    if (static_cast<int>(p) == list_property)
+                    {
+                        first_triangle[i + 1] = n >= 3 ? n - 2 : 0;
+                    }
+                }
+            }
+            if (cursor > end)
+            {
+                throw std::runtime_error("Truncated PLY face data: " + path);
+            }
+            for (size_t i = 0; i < element.count; ++i)
+            {
+                first_triangle[i + 1] += first_triangle[i];
+            }
+
+            faces.resize(3 * first_triangle[element.count]);
+            parallelChunks(element.count, workerCount(element.count / 65536 + 1), [&](int, size_t begin, size_t last) {
+                for (size_t i = begin; i < last; ++i)
+                {
+                    const char *record = records[i];
+                    for (size_t p = 0; p < element.properties.size(); ++p)
+                    {
+                        const PlyProperty &property = element.properties[p];
+                        if (!property.is_list)
+                        {
+                            record += plyTypeSize(property.type);
+                            continue;
+                        }
+                        size_t n = static_cast<size_t>(readPlyValue(record, property.count_type, swap));
+                        record += plyTypeSize(property.count_type);
+                        if (static_cast<int>(p) == list_property)
+                        {
+                            int size = plyTypeSize(property.type);
+                            int root = static_cast<int>(readPlyValue(record, property.type, swap));
+                            size_t out = 3 * first_triangle[i];
+                            for (size_t k = 1; k + 1 < n; ++k)
+                            {
+                                faces[out++] = root;
+                                faces[out++] = static_cast<int>(readPlyValue(record + k * size, property.type, swap));
+                                faces[out++] = static_cast<int>(readPlyValue(record + (k + 1) * size, property.type, swap));
+                            }
+                        }
+                        record += n * plyTypeSize(property.type);
+                    }
+                }
+            });
+        }
+        else if (!has_list)
+        {
+            cursor += stride * element.count;
+        }
+        else
+        {
+            throw std::runtime_error("Unsupported PLY element with list properties: " + element.name);
+        }
+    }
+
+    buildTriangles(vertices, faces, material, triangles);
+}
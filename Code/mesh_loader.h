@@ -0,0 +1,20 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <string>
+#include <vector>
+#include "triangle.h"
+#include "material.h"
+
+// Loads triangle meshes from Wavefront .obj or binary .ply files straight into
+// a triangle vector. Both parsers split the file into chunks that are decoded
+// on all hardware threads; polygons are fan-triangulated.
+class MeshLoader
+{
+public:
+    static void load(const std::string &path, const Material &material, std::vector<Triangle> &triangles);
+    static void loadObj(const std::string &path, const Material &material, std::vector<Triangle> &triangles);
+    static void loadPly(const std::string &path, const Material &material, std::vector<Triangle> &triangles);
+};
+
+#endif
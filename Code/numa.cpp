@@ -0,0 +1,64 @@
+#include "numa.h"
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+std::vector<int> parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    size_t position = 0;
+    while (position < list.size())
+    {
+        size_t comma = list.find(',', position);
+        std::string range = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+        size_t dash = range.find('-');
+        if (range.find_first_of("0123456789") != std::string::npos)
+        {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if (comma == std::string::npos)
+        {
+            break;
+        }
+        position = comma + 1;
+    }
+    return cpus;
+}
+
+static std::string readLine(const std::string &path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+NumaTopology NumaTopology::detect()
+{
+    NumaTopology topology;
+#ifdef __linux__
+    for (int node : parseCpuList(readLine("/sys/devices/system/node/online")))
+    {
+        std::vector<int> cpus = parseCpuList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        if (!cpus.empty())
+        {
+            topology.node_cpus.push_back(cpus);
+        }
+    }
+#endif
+    if (topology.node_cpus.empty())
+    {
+        std::vector<int> cpus;
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        topology.node_cpus.push_back(cpus);
+    }
+    return topology;
+}
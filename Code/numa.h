@@ -0,0 +1,21 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <string>
+#include <vector>
+
+// CPUs of each NUMA node, read from /sys/devices/system/node on Linux. Other
+// systems, or machines without that directory, report one node holding every
+// hardware thread.
+struct NumaTopology
+{
+    std::vector<std::vector<int>> node_cpus;
+
+    int nodeCount() const { return static_cast<int>(node_cpus.size()); }
+    static NumaTopology detect();
+};
+
+// Parses a kernel cpu list such as "0-3,8-11".
+std::vector<int> parseCpuList(const std::string &list);
+
+#endif
@@ -1,6 +1,7 @@
 #include "ppmWriter.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 PPMWriter::PPMWriter(int width, int height, const std::vector<unsigned char>& backgrounddata)
     : width(width), height(height), backgrounddata(backgrounddata)
@@ -22,13 +23,70 @@ void PPMWriter::getPixelData(int x, int y, const std::vector<unsigned char>& col
     pixeldata[index + 2] = colordata[2];
 }
 
-void PPMWriter::writePPM(const std::string& filename) const {
+void PPMWriter::setRegion(const ImageRegion& region, const unsigned char* colordata)
+{
+    for (int y = region.y0; y < region.y1; ++y)
+    {
+        std::copy(colordata + (y - region.y0) * region.width() * 3,
+                  colordata + (y - region.y0 + 1) * region.width() * 3,
+                  pixeldata.begin() + (y * width + region.x0) * 3);
+    }
+}
+
+bool PPMWriter::writeRegions(const std::string& filename, const std::vector<ImageRegion>& regions) const
+{
+    ImageRegion box = {width, height, 0, 0};
+    for (const auto& region : regions)
+    {
+        box.x0 = std::min(box.x0, region.x0);
+        box.y0 = std::min(box.y0, region.y0);
+        box.x1 = std::max(box.x1, region.x1);
+        box.y1 = std::max(box.y1, region.y1);
+    }
+    if (box.empty())
+    {
+        std::cerr << "Error: No region to write to " << filename << std::endl;
+        return false;
+    }
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
+        return false;
+    }
+    file << "P6\n# region " << width << " " << height << " " << box.x0 << " " << box.y0 << "\n";
+    for (const auto& region : regions)
+    {
+        file << "# tile " << region.x0 << " " << region.y0 << " " << region.x1 << " " << region.y1 << "\n";
+    }
+    file << box.width() << " " << box.height() << "\n255\n";
+    for (int y = box.y0; y < box.y1; ++y)
+    {
+        file.write(reinterpret_cast<const char*>(pixeldata.data()) + (y * width + box.x0) * 3, box.width() * 3);
+    }
+    file.close();
+    if (!file)
+    {
+        std::cerr << "Error: Could not write " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PPMWriter::writePPM(const std::string& filename) const {
     std::ofstream file(filename, std::ios::binary);
     if(file.is_open()) {
         file << "P6\n" << width << " " << height << "\n255\n";
         file.write(reinterpret_cast<const char*>(pixeldata.data()), pixeldata.size());
         file.close();
+        if(!file) {
+            std::cerr << "Error: Could not write " << filename << std::endl;
+            return false;
+        }
+        return true;
     } else {
         std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
+        return false;
     }
 }
\ No newline at end of file
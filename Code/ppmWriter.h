@@ -3,13 +3,23 @@
 
 #include <string>
 #include <vector>
+#include "image_region.h"
 
 class PPMWriter
 {
     public:
         PPMWriter(int width, int height, const std::vector<unsigned char>& backgrounddata);
         void getPixelData(int x, int y, const std::vector<unsigned char>& colordata);
-        void writePPM(const std::string& filename) const;
+        // Copies a block of RGB pixels, stored row by row, into region.
+        void setRegion(const ImageRegion& region, const unsigned char* colordata);
+        const std::vector<unsigned char>& getPixels() const { return pixeldata; }
+        void setPixels(const std::vector<unsigned char>& pixels) { pixeldata = pixels; }
+        // Both writers report failures on stderr and return false.
+        bool writePPM(const std::string& filename) const;
+        // Writes only the bounding box of regions. Header comments record the
+        // full image size, the box origin and which rectangles were rendered,
+        // so PPMMerge can assemble partial renders into the final image.
+        bool writeRegions(const std::string& filename, const std::vector<ImageRegion>& regions) const;
     
     private:
         int width;
@@ -0,0 +1,187 @@
+#include "ppm_merge.h"
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "image_region.h"
+
+namespace
+{
+struct PartialImage
+{
+    int full_width = 0;
+    int full_height = 0;
+    int origin_x = 0;
+    int origin_y = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<ImageRegion> tiles;
+    std::vector<unsigned char> pixels;
+};
+
+// Reads a binary PPM, collecting the region comments from its header.
+PartialImage readPartial(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    PartialImage part;
+    bool has_region = false;
+    std::vector<std::string> tokens;
+    while (tokens.size() < 4)
+    {
+        int c = file.get();
+        if (c == EOF)
+        {
+            throw std::runtime_error("Truncated PPM header in " + path);
+        }
+        if (c == '#')
+        {
+            std::string comment;
+            std::getline(file, comment);
+            std::istringstream fields(comment);
+            std::string kind;
+            fields >> kind;
+            if (kind == "region")
+            {
+                fields >> part.full_width >> part.full_height >> part.origin_x >> part.origin_y;
+                has_region = true;
+            }
+            else if (kind == "tile")
+            {
+                ImageRegion tile;
+                fields >> tile.x0 >> tile.y0 >> tile.x1 >> tile.y1;
+                part.tiles.push_back(tile);
+            }
+            continue;
+        }
+        if (std::isspace(c))
+        {
+            continue;
+        }
+        std::string token(1, static_cast<char>(c));
+        while (file.peek() != EOF && !std::isspace(file.peek()))
+        {
+            token += static_cast<char>(file.get());
+        }
+        tokens.push_back(token);
+    }
+    file.get();
+    if (tokens[0] != "P6" || tokens[3] != "255")
+    {
+        throw std::runtime_error(path + " is not an 8-bit binary PPM");
+    }
+    part.width = std::stoi(tokens[1]);
+    part.height = std::stoi(tokens[2]);
+
+    // A plain image counts as one part covering everything.
+    if (!has_region)
+    {
+        part.full_width = part.width;
+        part.full_height = part.height;
+        part.tiles.push_back({0, 0, part.width, part.height});
+    }
+
+    part.pixels.resize(static_cast<size_t>(part.width) * part.height * 3);
+    file.read(reinterpret_cast<char *>(part.pixels.data()), part.pixels.size());
+    if (file.gcount() != static_cast<std::streamsize>(part.pixels.size()))
+    {
+        throw std::runtime_error("Truncated pixel data in " + path);
+    }
+    for (const auto &tile : part.tiles)
+    {
+        if (tile.empty() || tile.x0 < part.origin_x || tile.y0 < part.origin_y ||
+            tile.x1 > part.origin_x + part.width || tile.y1 > part.origin_y + part.height ||
+            tile.x1 > part.full_width || tile.y1 > part.full_height)
+        {
+            throw std::runtime_error("Tile outside the image in " + path);
+        }
+    }
+    return part;
+}
+} // namespace
+
+void PPMMerge::merge(const std::vector<std::string> &parts, const std::string &output)
+{
+    if (parts.empty())
+    {
+        throw std::runtime_error("Nothing to merge");
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> image;
+    std::vector<unsigned char> covered;
+    size_t overlapping = 0;
+    for (const auto &path : parts)
+    {
+        PartialImage part = readPartial(path);
+        if (image.empty())
+        {
+            width = part.full_width;
+            height = part.full_height;
+            image.assign(static_cast<size_t>(width) * height * 3, 0);
+            covered.assign(static_cast<size_t>(width) * height, 0);
+        }
+        else if (part.full_width != width || part.full_height != height)
+        {
+            throw std::runtime_error(path + " belongs to a " + std::to_string(part.full_width) + "x" +
+                                     std::to_string(part.full_height) + " image, expected " +
+                                     std::to_string(width) + "x" + std::to_string(height));
+        }
+
+        for (const auto &tile : part.tiles)
+        {
+            for (int y = tile.y0; y < tile.y1; ++y)
+            {
+                for (int x = tile.x0; x < tile.x1; ++x)
+                {
+                    size_t target = static_cast<size_t>(y) * width + x;
+                    size_t source = static_cast<size_t>(y - part.origin_y) * part.width + (x - part.origin_x);
+                    overlapping += covered[target];
+                    covered[target] = 1;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        image[target * 3 + c] = part.pixels[source * 3 + c];
+                    }
+                }
+            }
+        }
+    }
+
+    size_t missing = 0;
+    size_t first_missing = 0;
+    for (size_t i = covered.size(); i-- > 0;)
+    {
+        if (!covered[i])
+        {
+            ++missing;
+            first_missing = i;
+        }
+    }
+    if (missing > 0)
+    {
+        throw std::runtime_error("Merge incomplete: " + std::to_string(missing) + " of " + std::to_string(covered.size()) +
+                                 " pixels missing, first at (" + std::to_string(first_missing % width) + ", " +
+                                 std::to_string(first_missing / width) + ")");
+    }
+
+    std::ofstream file(output, std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open " + output + " for writing");
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(image.data()), image.size());
+
+    std::cout << "Merged " << parts.size() << " parts into " << output << " (" << width << "x" << height << ")";
+    if (overlapping > 0)
+    {
+        std::cout << ", " << overlapping << " pixels covered more than once";
+    }
+    std::cout << std::endl;
+}
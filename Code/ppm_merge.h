@@ -0,0 +1,16 @@
+#ifndef PPM_MERGE_H
+#define PPM_MERGE_H
+
+#include <string>
+#include <vector>
+
+// Assembles partial renders written by PPMWriter::writeRegions (or whole PPM
+// images) into one image. Throws if the parts disagree on the image size or
+// if any pixel is left uncovered, so a lost or failed part cannot go unnoticed.
+class PPMMerge
+{
+public:
+    static void merge(const std::vector<std::string> &parts, const std::string &output);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Stateless counter-based random numbers. Every value is a hash of
+// (seed, pixel, sample, bounce, draw index), so a pixel gets the same numbers
+// whichever thread renders it and in whatever order, and threads share no
+// generator state.
+inline uint32_t pcgHash(uint32_t value)
+{
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+class RandomStream
+{
+public:
+    RandomStream(uint32_t pixel, uint32_t sample, uint32_t bounce, uint32_t seed = 0)
+        : key(pcgHash(seed ^ pcgHash(pixel ^ pcgHash(sample ^ pcgHash(bounce))))) {}
+
+    uint32_t nextUint() { return pcgHash(key ^ pcgHash(counter++)); }
+    // Uniform in [0, 1), using the top 24 bits so every value is exact in float.
+    float nextFloat() { return (nextUint() >> 8) * (1.0f / 16777216.0f); }
+
+private:
+    uint32_t key;
+    uint32_t counter = 0;
+};
+
+#endif
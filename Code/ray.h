@@ -1,11 +1,35 @@
 #pragma once
 
-#include <vector>
+#include <cstdint>
+#include <limits>
+#include "vector_utils.h"
 
+// A ray and the open interval (t_min, t_max) of distances it accepts hits in.
+// The reciprocal direction and its sign bits are computed once here, so slab
+// tests multiply instead of divide and pick near/far planes without swaps.
+// Closest-hit queries shrink t_max as they go, which lets every kernel reject
+// hits behind the current closest one. Rays spawned off a surface name the
+// primitive they start on (a GeometryGroup id within instance, -1 for the
+// scene's own shapes) so intersection can skip it instead of relying on an
+// epsilon; exclude_primitive is -1 for rays that skip nothing.
 class Ray {
   public:
-    std::vector<float> origin;
-    std::vector<float> direction;
-    Ray(std::vector<float>& origin,std::vector<float>& direction)
-        : origin(origin), direction(direction) {}
+    Vec3 origin;
+    Vec3 direction;
+    Vec3 inv_direction;
+    uint8_t sign[3];
+    float t_min;
+    float t_max;
+    int exclude_primitive = -1;
+    int exclude_instance = -1;
+    Ray(const Vec3& origin, const Vec3& direction, float t_min = 0.0f, float t_max = std::numeric_limits<float>::max())
+        : origin(origin), direction(direction), t_min(t_min), t_max(t_max)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            inv_direction[i] = 1.0f / direction[i];
+            // Taken from the reciprocal so that -0 counts as negative.
+            sign[i] = inv_direction[i] < 0.0f;
+        }
+    }
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include <cstdint>
+#include "aabb.h"
+#include "ray.h"
+#include "simd.h"
+
+// Up to kMaxRays rays in structure-of-arrays form, so one box can be tested
+// against the whole packet kSimdWidth rays at a time. Bit i of a mask stands
+// for rays[i]; the rays themselves stay with the caller.
+struct RayPacket
+{
+    static const int kMaxRays = 64;
+
+    float ox[kMaxRays], oy[kMaxRays], oz[kMaxRays];
+    float ix[kMaxRays], iy[kMaxRays], iz[kMaxRays];
+    float t_min[kMaxRays], t_max[kMaxRays];
+    const Ray *rays = nullptr;
+    int count = 0;
+
+    RayPacket(const Ray *rays, int count) : rays(rays), count(count)
+    {
+        // Lanes past count are loaded with the rest of their batch, so give
+        // them defined values; masks never select them.
+        int padded = (count + kSimdWidth - 1) / kSimdWidth * kSimdWidth;
+        for (int i = 0; i < padded; ++i)
+        {
+            const Ray &ray = rays[i < count ? i : 0];
+            ox[i] = ray.origin[0];
+            oy[i] = ray.origin[1];
+            oz[i] = ray.origin[2];
+            ix[i] = ray.inv_direction[0];
+            iy[i] = ray.inv_direction[1];
+            iz[i] = ray.inv_direction[2];
+            t_min[i] = ray.t_min;
+            t_max[i] = ray.t_max;
+        }
+    }
+
+    uint64_t all() const { return count == kMaxRays ? ~uint64_t(0) : (uint64_t(1) << count) - 1; }
+
+    // The rays of active whose interval overlaps box; per ray, the same
+    // answer as Aabb::intersect.
+    uint64_t intersect(const Aabb &box, uint64_t active) const
+    {
+        const uint64_t lanes = (uint64_t(1) << kSimdWidth) - 1;
+        SimdFloat zero = simdSet(0.0f);
+        SimdFloat box_min[3] = {simdSet(box.min[0]), simdSet(box.min[1]), simdSet(box.min[2])};
+        SimdFloat box_max[3] = {simdSet(box.max[0]), simdSet(box.max[1]), simdSet(box.max[2])};
+        const float *origins[3] = {ox, oy, oz};
+        const float *inverses[3] = {ix, iy, iz};
+        uint64_t hits = 0;
+        for (int i = 0; i < count; i += kSimdWidth)
+        {
+            if (!(active >> i & lanes))
+            {
+                continue;
+            }
+            SimdFloat t_near = simdLoad(&t_min[i]);
+            SimdFloat t_far = simdLoad(&t_max[i]);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                SimdFloat origin = simdLoad(&origins[axis][i]);
+                SimdFloat inverse = simdLoad(&inverses[axis][i]);
+                SimdFloat negative = simdCmpLt(inverse, zero);
+                SimdFloat t0 = simdMul(simdSub(simdSelect(negative, box_max[axis], box_min[axis]), origin), inverse);
+                SimdFloat t1 = simdMul(simdSub(simdSelect(negative, box_min[axis], box_max[axis]), origin), inverse);
+                // Operand order keeps the current bound when a product is NaN.
+                t_near = simdMax(t0, t_near);
+                t_far = simdMin(t1, t_far);
+            }
+            hits |= static_cast<uint64_t>(simdMask(simdCmpLe(t_near, t_far))) << i;
+        }
+        return hits & active;
+    }
+};
+
+#endif
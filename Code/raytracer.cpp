@@ -1,16 +1,255 @@
 #include "tools.h"
 #include "ppmWriter.h"
+#include "ppm_merge.h"
+#include "render_server.h"
+#include <cstdio>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
-int main()
+// Usage: raytracer [scene.json] [output] [--crop x0,y0,x1,y1 | --tiles first:last]
+//                  [--tile-size n] [--tile-order hilbert|morton|scanline]
+//                  [--checkpoint file [--checkpoint-interval seconds]] [--numa]
+//                  [--wavefront] [--bench-bvh] [--min-contribution w [--bench-pruning]]
+//                  [--aov prefix]
+//        Scenes with an "animation" block render their whole frame range;
+//        output is then a frame name pattern. --crop and --tiles render part
+//        of the frame (tiles are numbered row-major) for a later --merge.
+//        --checkpoint periodically saves finished tiles (default every 60 s);
+//        rerunning the same command resumes from it, and it is removed once
+//        the output is written. --numa pins render threads and keeps a scene
+//        copy per NUMA node. --wavefront traces rays in per-bounce batches and
+//        reports the time spent in each stage. --bench-bvh compares ray query
+//        speed and node memory of the binary and compressed BVH layouts, and
+//        single-ray against packet coverage queries.
+//        --min-contribution skips reflection and refraction rays whose color
+//        would reach the pixel scaled by less than w (scene key
+//        "mincontribution"); --bench-pruning compares that render with an
+//        unpruned one. --aov also writes the first hit's depth, normal, albedo
+//        and primitive/instance/material ids to prefix_depth.pfm,
+//        prefix_normal.pfm, prefix_albedo.pfm and prefix_id.pfm (still images only).
+//        raytracer --merge output part... assembles partial renders.
+//        raytracer --serve [socket] keeps scenes resident and takes render jobs
+//        from the socket, or from stdin when no socket is given (see render_server.h).
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "--serve")
+    {
+        RenderServer server;
+        if (argc > 2)
+        {
+            server.serveSocket(argv[2]);
+        }
+        else
+        {
+            server.serveStream(std::cin, std::cout);
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--merge")
+    {
+        if (argc < 4)
+        {
+            std::cerr << "Usage: raytracer --merge output part..." << std::endl;
+            return 1;
+        }
+        try
+        {
+            PPMMerge::merge(std::vector<std::string>(argv + 3, argv + argc), argv[2]);
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::vector<std::string> positional;
+    ImageRegion crop;
+    bool has_crop = false;
+    int first_tile = -1, last_tile = -1;
+    bool has_tiles = false;
+    int tile_size = 0;
+    std::string tile_order;
+    std::string checkpoint;
+    double checkpoint_interval = 60.0;
+    bool numa = false;
+    bool wavefront = false;
+    bool bench_bvh = false;
+    float min_contribution = -1.0f;
+    bool bench_pruning = false;
+    std::string aov_prefix;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--crop" && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%d,%d,%d,%d", &crop.x0, &crop.y0, &crop.x1, &crop.y1) != 4)
+            {
+                std::cerr << "--crop expects x0,y0,x1,y1" << std::endl;
+                return 1;
+            }
+            if (crop.empty())
+            {
+                std::cerr << "--crop needs x1 > x0 and y1 > y0" << std::endl;
+                return 1;
+            }
+            has_crop = true;
+        }
+        else if (arg == "--tiles" && i + 1 < argc)
+        {
+            if (std::sscanf(argv[++i], "%d:%d", &first_tile, &last_tile) != 2)
+            {
+                std::cerr << "--tiles expects first:last" << std::endl;
+                return 1;
+            }
+            if (first_tile < 0 || last_tile < first_tile)
+            {
+                std::cerr << "--tiles needs 0 <= first <= last" << std::endl;
+                return 1;
+            }
+            has_tiles = true;
+        }
+        else if (arg == "--tile-size" && i + 1 < argc)
+        {
+            tile_size = std::stoi(argv[++i]);
+        }
+        else if (arg == "--tile-order" && i + 1 < argc)
+        {
+            tile_order = argv[++i];
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc)
+        {
+            checkpoint = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc)
+        {
+            checkpoint_interval = std::stod(argv[++i]);
+        }
+        else if (arg == "--numa")
+        {
+            numa = true;
+        }
+        else if (arg == "--wavefront")
+        {
+            wavefront = true;
+        }
+        else if (arg == "--bench-bvh")
+        {
+            bench_bvh = true;
+        }
+        else if (arg == "--min-contribution" && i + 1 < argc)
+        {
+            min_contribution = std::stof(argv[++i]);
+        }
+        else if (arg == "--bench-pruning")
+        {
+            bench_pruning = true;
+        }
+        else if (arg == "--aov" && i + 1 < argc)
+        {
+            aov_prefix = argv[++i];
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+
     Tools tools;
-    tools.readConfig("../TestSuite/scene.json");
-    int width = 1200;
-    int height = 800;
+    tools.readConfig(positional.size() > 0 ? positional[0] : "../TestSuite/scene.json");
+    if (numa)
+    {
+        tools.enableNuma();
+    }
+    if (wavefront)
+    {
+        tools.setWavefront(true);
+    }
+    if (bench_bvh)
+    {
+        tools.benchmarkBvh();
+        return 0;
+    }
+    if (min_contribution >= 0.0f)
+    {
+        tools.setMinContribution(min_contribution);
+    }
+    if (tile_size > 0)
+    {
+        tools.setTileSize(tile_size);
+    }
+    if (!tile_order.empty())
+    {
+        TileOrder order;
+        if (!parseTileOrder(tile_order, order))
+        {
+            std::cerr << "--tile-order expects hilbert, morton or scanline" << std::endl;
+            return 1;
+        }
+        tools.setTileOrder(order);
+    }
+    if (bench_pruning)
+    {
+        tools.benchmarkPruning();
+        return 0;
+    }
+    std::string output = positional.size() > 1 ? positional[1] : "";
+    if (tools.isAnimated())
+    {
+        tools.renderAnimation(output, "phong");
+        return 0;
+    }
+
+    int width = tools.getCamera().width;
+    int height = tools.getCamera().height;
+    tile_size = tools.getTileSize();
+    std::vector<ImageRegion> regions;
+    if (has_crop)
+    {
+        regions.push_back(clipRegion(crop, width, height));
+    }
+    if (has_tiles)
+    {
+        int count = tileCount(width, height, tile_size);
+        for (int tile = first_tile; tile <= last_tile && tile < count; ++tile)
+        {
+            regions.push_back(tileRegion(width, height, tile_size, tile));
+        }
+    }
+    if ((has_crop || has_tiles) && (regions.empty() || regions[0].empty()))
+    {
+        std::cerr << "Requested region lies outside the " << width << "x" << height << " image" << std::endl;
+        return 1;
+    }
+
     std::vector<unsigned char> backgrounddata = {64, 64, 64};
     PPMWriter ppmwriter(width, height, backgrounddata);
-    tools.render(ppmwriter, "phong");
-    ppmwriter.writePPM("output.ppm");
+    if (!checkpoint.empty())
+    {
+        tools.setCheckpoint(checkpoint, checkpoint_interval);
+    }
+    std::unique_ptr<AovBuffers> aovs;
+    if (!aov_prefix.empty())
+    {
+        aovs.reset(new AovBuffers(width, height));
+        tools.setAovOutput(aovs.get());
+    }
+    tools.render(ppmwriter, "phong", regions);
+    if (aovs)
+    {
+        aovs->write(aov_prefix);
+    }
+    bool written = regions.empty() ? ppmwriter.writePPM(output.empty() ? "output.ppm" : output)
+                                   : ppmwriter.writeRegions(output.empty() ? "output.part.ppm" : output, regions);
+    // The checkpoint is the only copy of the render until the image is safely
+    // on disk.
+    if (!written)
+    {
+        return 1;
+    }
+    tools.clearCheckpoint();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "render_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <nlohmann/json.hpp>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+using json = nlohmann::json;
+
+static std::vector<float> parseVector(const json &value)
+{
+    std::vector<float> vector = value.get<std::vector<float>>();
+    if (vector.size() != 3)
+    {
+        throw std::runtime_error("Camera vectors need 3 components");
+    }
+    return vector;
+}
+
+// The cache lock is only held for lookups, so a cached scene does not wait
+// behind a slow load. Two jobs that miss at once both load the scene; the
+// first to finish is kept unless a reload asked for the newer one.
+std::shared_ptr<const Tools> RenderServer::loadScene(const std::string &path, bool reload)
+{
+    if (!reload)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto cached = scenes.find(path);
+        if (cached != scenes.end())
+        {
+            return cached->second;
+        }
+    }
+
+    auto tools = std::make_shared<Tools>();
+    tools->setLog(std::cerr);
+    tools->readConfig(path);
+    if (tools->isAnimated())
+    {
+        // Jobs share the scene, so it is served at its static pose.
+        std::cerr << "Ignoring animation block in served scene " << path << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto cached = scenes.find(path);
+    if (cached != scenes.end() && !reload)
+    {
+        return cached->second;
+    }
+    scenes[path] = tools;
+    return tools;
+}
+
+std::string RenderServer::runJob(const std::string &line)
+{
+    json reply;
+    try
+    {
+        json job = json::parse(line);
+        reply["id"] = job.value("id", json());
+        std::string rendermode = job.value("rendermode", std::string("phong"));
+        if (rendermode != "phong" && rendermode != "binary")
+        {
+            throw std::runtime_error("Unknown render mode '" + rendermode + "'");
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const Tools> scene = loadScene(job.at("scene").get<std::string>(), job.value("reload", false));
+
+        // A per-job copy carries the camera overrides; the scene itself is shared.
+        Tools tools = *scene;
+        tools.setLog(std::cerr);
+        Camera camera = tools.getCamera();
+        camera.width = job.value("width", camera.width);
+        camera.height = job.value("height", camera.height);
+        if (camera.width <= 0 || camera.height <= 0)
+        {
+            throw std::runtime_error("Image size must be positive");
+        }
+        if (job.contains("camera"))
+        {
+            const json &overrides = job["camera"];
+            if (overrides.contains("position"))
+            {
+                camera.position = parseVector(overrides["position"]);
+            }
+            if (overrides.contains("lookAt"))
+            {
+                camera.lookAt = parseVector(overrides["lookAt"]);
+            }
+            if (overrides.contains("upVector"))
+            {
+                camera.upVector = parseVector(overrides["upVector"]);
+            }
+            camera.fov = overrides.value("fov", camera.fov);
+            camera.samples = std::max(1, overrides.value("samples", camera.samples));
+        }
+        tools.setCamera(camera);
+
+        std::string output = job.at("output").get<std::string>();
+        std::vector<unsigned char> backgrounddata = {64, 64, 64};
+        PPMWriter ppmwriter(camera.width, camera.height, backgrounddata);
+        tools.render(ppmwriter, rendermode);
+        if (!ppmwriter.writePPM(output))
+        {
+            throw std::runtime_error("Could not write " + output);
+        }
+
+        reply["status"] = "ok";
+        reply["output"] = output;
+        reply["ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    catch (const std::exception &error)
+    {
+        reply["status"] = "error";
+        reply["message"] = error.what();
+    }
+    return reply.dump();
+}
+
+void RenderServer::serveStream(std::istream &in, std::ostream &out)
+{
+    std::mutex out_mutex;
+    TaskGroup jobs(ThreadPool::shared());
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        jobs.run([this, line, &out, &out_mutex] {
+            std::string reply = runJob(line);
+            std::lock_guard<std::mutex> lock(out_mutex);
+            out << reply << std::endl;
+        });
+    }
+    jobs.wait();
+}
+
+void RenderServer::serveConnection(int fd)
+{
+    std::mutex write_mutex;
+    // Set once a reply cannot be delivered; later replies are dropped.
+    bool client_gone = false;
+    TaskGroup jobs(ThreadPool::shared());
+    std::string pending;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        pending.append(buffer, static_cast<size_t>(received));
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos)
+        {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            jobs.run([this, line, fd, &write_mutex, &client_gone] {
+                std::string reply = runJob(line) + "\n";
+                std::lock_guard<std::mutex> lock(write_mutex);
+                size_t written = 0;
+                while (!client_gone && written < reply.size())
+                {
+                    // A plain write to a closed socket raises SIGPIPE, which
+                    // would take down the server and every other client.
+                    ssize_t result = send(fd, reply.data() + written, reply.size() - written, MSG_NOSIGNAL);
+                    if (result < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (result <= 0)
+                    {
+                        client_gone = true;
+                        break;
+                    }
+                    written += static_cast<size_t>(result);
+                }
+            });
+        }
+    }
+    jobs.wait();
+    close(fd);
+}
+
+void RenderServer::serveSocket(const std::string &path)
+{
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        throw std::runtime_error("Could not create socket");
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 16) < 0)
+    {
+        close(listener);
+        throw std::runtime_error("Could not listen on " + path + ": " + std::strerror(errno));
+    }
+    std::cerr << "Listening on " << path << std::endl;
+
+    // One reader thread per client; the rendering itself happens on the pool.
+    while (true)
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        std::thread([this, client] { serveConnection(client); }).detach();
+    }
+    close(listener);
+}
@@ -0,0 +1,39 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "tools.h"
+
+// Long-running render service. Jobs arrive as one JSON object per line, on a
+// stream or a Unix domain socket, and run concurrently on the shared thread
+// pool. Parsed scenes and their BVHs stay resident, keyed by scene path.
+//
+// Job:   {"id": any, "scene": path, "output": path, "rendermode": "phong",
+//         "width": w, "height": h, "reload": false,
+//         "camera": {"position": [..], "lookAt": [..], "upVector": [..], "fov": f, "samples": n}}
+// Reply: {"id": any, "status": "ok", "output": path, "ms": t}
+//     or {"id": any, "status": "error", "message": text}
+// Everything but "scene" and "output" is optional and defaults to the scene file.
+// "rendermode" is "phong" (the default) or "binary".
+class RenderServer
+{
+public:
+    // Serves until the input stream ends, then waits for running jobs.
+    void serveStream(std::istream &in, std::ostream &out);
+    // Serves clients on the socket until the process is terminated.
+    void serveSocket(const std::string &path);
+
+private:
+    void serveConnection(int fd);
+    std::string runJob(const std::string &line);
+    std::shared_ptr<const Tools> loadScene(const std::string &path, bool reload);
+
+    std::mutex cache_mutex;
+    std::map<std::string, std::shared_ptr<const Tools>> scenes;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "scene.h"
+#include <algorithm>
+#include <cmath>
+#include "vector_utils.h"
+
+void Scene::commit()
+{
+    shapes.commit();
+    for (auto &group : groups)
+    {
+        group.commit();
+    }
+
+    std::vector<Aabb> instance_bounds;
+    instance_bounds.reserve(instances.size());
+    for (auto &instance : instances)
+    {
+        instance.updateBounds(groups[instance.group].bounds());
+        instance_bounds.push_back(instance.bounds);
+    }
+    instance_bvh.build(instance_bounds);
+}
+
+int Scene::refit(float rebuild_threshold)
+{
+    int rebuilt = shapes.refit(rebuild_threshold);
+    for (auto &group : groups)
+    {
+        rebuilt += group.refit(rebuild_threshold);
+    }
+
+    std::vector<Aabb> instance_bounds;
+    instance_bounds.reserve(instances.size());
+    for (auto &instance : instances)
+    {
+        instance.updateBounds(groups[instance.group].bounds());
+        instance_bounds.push_back(instance.bounds);
+    }
+    rebuilt += instance_bvh.refit(instance_bounds, rebuild_threshold);
+    return rebuilt;
+}
+
+void Scene::setCompressedNodes(bool enabled)
+{
+    shapes.setCompressed(enabled);
+    for (auto &group : groups)
+    {
+        group.setCompressed(enabled);
+    }
+}
+
+size_t Scene::nodeBytes() const
+{
+    size_t bytes = shapes.nodeBytes() + instance_bvh.nodes.size() * sizeof(BvhNode);
+    for (const auto &group : groups)
+    {
+        bytes += group.nodeBytes();
+    }
+    return bytes;
+}
+
+// Carries a world-space ray into an instance's object space. The object-space
+// direction is renormalized for the kernels; scale converts object distances
+// back to world distances, and the ray's interval is converted the other way.
+static Ray toObjectSpace(const Ray &ray, const Instance &instance, float &scale)
+{
+    Vec3 origin;
+    Vec3 direction;
+    transformPoint(instance.world_to_object, ray.origin.data(), origin.data());
+    transformVector(instance.world_to_object, ray.direction.data(), direction.data());
+    float length = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    direction[0] /= length;
+    direction[1] /= length;
+    direction[2] /= length;
+    scale = 1.0f / length;
+    return Ray(origin, direction, ray.t_min * length, ray.t_max * length);
+}
+
+// A ray's excluded primitive belongs to one group only: the scene's shapes
+// when exclude_instance is -1, otherwise that instance's group.
+static int exclusionFor(const Ray &ray, int instance)
+{
+    return ray.exclude_instance == instance ? ray.exclude_primitive : -1;
+}
+
+bool Scene::intersect(const Ray &ray, HitRecord &hit) const
+{
+    Ray query = ray;
+    query.exclude_primitive = exclusionFor(ray, -1);
+    bool found = false;
+    if (shapes.intersect(query, hit))
+    {
+        hit.instance = -1;
+        found = true;
+    }
+
+    instance_bvh.traverse(query, [&](const BvhNode &leaf) {
+        for (int i = leaf.left_first; i < leaf.left_first + leaf.count; ++i)
+        {
+            int index = instance_bvh.indices[i];
+            const Instance &instance = instances[index];
+            float scale;
+            Ray local = toObjectSpace(query, instance, scale);
+            local.exclude_primitive = exclusionFor(ray, index);
+
+            HitRecord local_hit;
+            if (groups[instance.group].intersect(local, local_hit))
+            {
+                query.t_max = local_hit.t * scale;
+                hit = local_hit;
+                hit.t = query.t_max;
+                hit.instance = index;
+                found = true;
+            }
+        }
+        return false;
+    });
+
+    return found;
+}
+
+bool Scene::occluded(const Ray &ray) const
+{
+    Ray query = ray;
+    query.exclude_primitive = exclusionFor(ray, -1);
+    if (shapes.occluded(query))
+    {
+        return true;
+    }
+
+    bool blocked = false;
+    instance_bvh.traverse(query, [&](const BvhNode &leaf) {
+        for (int i = leaf.left_first; i < leaf.left_first + leaf.count; ++i)
+        {
+            int index = instance_bvh.indices[i];
+            const Instance &instance = instances[index];
+            float scale;
+            Ray local = toObjectSpace(query, instance, scale);
+            local.exclude_primitive = exclusionFor(ray, index);
+            if (groups[instance.group].occluded(local))
+            {
+                blocked = true;
+                return true;
+            }
+        }
+        return false;
+    });
+    return blocked;
+}
+
+// The packet stays together through the shapes and the instance BVH; each
+// ray then tests the groups of the instances it reached on its own, in that
+// instance's object space.
+uint64_t Scene::occluded(const Ray *rays, int count) const
+{
+    RayPacket packet(rays, count);
+    int exclude[RayPacket::kMaxRays];
+    for (int i = 0; i < count; ++i)
+    {
+        exclude[i] = exclusionFor(rays[i], -1);
+    }
+    uint64_t active = packet.all();
+    uint64_t blocked = shapes.occluded(packet, active, exclude);
+    active &= ~blocked;
+
+    instance_bvh.traversePacket(packet, active, [&](const BvhNode &leaf, uint64_t mask) {
+        uint64_t answered = 0;
+        for (int r = 0; r < count; ++r)
+        {
+            if (!(mask >> r & 1))
+            {
+                continue;
+            }
+            for (int i = leaf.left_first; i < leaf.left_first + leaf.count; ++i)
+            {
+                int index = instance_bvh.indices[i];
+                const Instance &instance = instances[index];
+                float scale;
+                Ray local = toObjectSpace(rays[r], instance, scale);
+                local.exclude_primitive = exclusionFor(rays[r], index);
+                if (groups[instance.group].occluded(local))
+                {
+                    answered |= uint64_t(1) << r;
+                    break;
+                }
+            }
+        }
+        blocked |= answered;
+        return answered;
+    });
+    return blocked;
+}
+
+void Scene::surfaceAt(const Ray &ray, const HitRecord &hit, Vec3 &point, Vec3 &normal, const Material *&material) const
+{
+    point = {ray.origin[0] + hit.t * ray.direction[0],
+             ray.origin[1] + hit.t * ray.direction[1],
+             ray.origin[2] + hit.t * ray.direction[2]};
+
+    if (hit.instance < 0)
+    {
+        normal = shapes.normalAt(hit, point);
+        material = &shapes.materialOf(hit);
+        return;
+    }
+
+    const Instance &instance = instances[hit.instance];
+    const GeometryGroup &group = groups[instance.group];
+    Vec3 local_point;
+    transformPoint(instance.world_to_object, point.data(), local_point.data());
+    Vec3 local_normal = group.normalAt(hit, local_point);
+
+    transformNormal(instance.world_to_object, local_normal.data(), normal.data());
+    normalize(normal);
+    material = instance.has_material ? &instance.material : &group.materialOf(hit);
+}
+
+// The origin moves off the surface, to the side the ray leaves to, by the
+// rounding error the point can carry: it was computed as origin + t * dir,
+// so that error scales with the larger of t and the point's coordinates,
+// whatever the scene's units. The ray also skips the primitive it starts on
+// wherever that primitive cannot block it: triangles are flat, so always, and
+// spheres and capped cylinders are convex, so whenever the ray heads outwards.
+// A ray heading into one of those must still find where it leaves it.
+Ray Scene::spawnRay(const HitRecord &hit, const Vec3 &point, const Vec3 &normal, const Vec3 &direction) const
+{
+    float cos_out = normal[0] * direction[0] + normal[1] * direction[1] + normal[2] * direction[2];
+    Vec3 side = cos_out < 0.0f ? Vec3{-normal[0], -normal[1], -normal[2]} : normal;
+    float magnitude = std::max(hit.t, std::max(std::fabs(point[0]), std::max(std::fabs(point[1]), std::fabs(point[2]))));
+    Ray ray(offsetOrigin(point, side, magnitude), direction);
+    if (hit.kind == PrimitiveKind::Triangle || cos_out > 0.0f)
+    {
+        ray.exclude_primitive = primitiveId(hit);
+        ray.exclude_instance = hit.instance;
+    }
+    return ray;
+}
+
+int Scene::primitiveId(const HitRecord &hit) const
+{
+    const GeometryGroup &group = hit.instance < 0 ? shapes : groups[instances[hit.instance].group];
+    return group.primitiveId(hit);
+}
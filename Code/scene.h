@@ -0,0 +1,50 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include "ray.h"
+#include "material.h"
+#include "geometry_group.h"
+#include "instance.h"
+#include "bvh.h"
+#include "hit_record.h"
+
+// Two-level scene: shapes placed directly in the scene plus instances of shared
+// geometry groups. Instances are found through a top-level BVH over their
+// world bounds; each group carries its own bottom-level BVH, so memory scales
+// with the unique geometry rather than with the number of placed copies.
+class Scene
+{
+public:
+    void commit();
+    // Per-frame update for animated scenes: refits every BVH to moved shapes
+    // and instance transforms instead of rebuilding. Returns the number of
+    // subtrees that degraded past rebuild_threshold and were rebuilt.
+    int refit(float rebuild_threshold);
+    bool intersect(const Ray &ray, HitRecord &hit) const;
+    bool occluded(const Ray &ray) const;
+    // Any-hit for up to RayPacket::kMaxRays rays traced as one packet; bit i
+    // of the result is set when rays[i] hits anything. Pays off for coherent
+    // rays, such as the camera rays of a pixel block.
+    uint64_t occluded(const Ray *rays, int count) const;
+    void surfaceAt(const Ray &ray, const HitRecord &hit, Vec3 &point, Vec3 &normal, const Material *&material) const;
+    // Secondary or shadow ray leaving the surface point of hit, with normal
+    // the outward normal from surfaceAt. Self-intersection is avoided without
+    // any scene-scale epsilon; see the definition.
+    Ray spawnRay(const HitRecord &hit, const Vec3 &point, const Vec3 &normal, const Vec3 &direction) const;
+    // Index of the hit primitive within its geometry group (see GeometryGroup::primitiveId).
+    int primitiveId(const HitRecord &hit) const;
+    // Switches every geometry group between binary and compressed BVH nodes
+    // (see CompressedBvh); the small instance BVH stays binary.
+    void setCompressedNodes(bool enabled);
+    size_t nodeBytes() const;
+
+    GeometryGroup shapes;
+    std::vector<GeometryGroup> groups;
+    std::vector<Instance> instances;
+
+private:
+    Bvh instance_bvh;
+};
+
+#endif
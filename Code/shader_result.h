@@ -1,16 +1,21 @@
 #ifndef SHADER_RESULT_H
 #define SHADER_RESULT_H
 
-#include <vector>
+#include "hit_record.h"
 #include "material.h"
+#include "vector_utils.h"
 
+// The material is referenced, not copied: it lives in the scene for as long
+// as the render does.
 struct ShaderResult
 {
-    std::vector<float> color;
+    Vec3 color;
     bool intersected;
-    std::vector<float> intersection_point;
-    Material intersected_material;
-    std::vector<float> normal;
+    Vec3 intersection_point;
+    const Material *intersected_material;
+    Vec3 normal;
+    // Which primitive was hit, for spawning rays off it.
+    HitRecord hit;
 };
 
 #endif
@@ -1,48 +1,19 @@
 #include "shadow.h"
 #include "vector_utils.h"
 
-bool Shadow::isInShadow(const std::vector<float>& point, const Light& light, const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles)
+Ray Shadow::shadowRay(const Scene& scene, const HitRecord& hit, const Vec3& point, const Vec3& normal, const Light& light)
 {
-    std::vector<float> lightDir = {
+    Vec3 lightDir = {
         light.light_position[0] - point[0],
         light.light_position[1] - point[1],
         light.light_position[2] - point[2]
     };
     normalize(lightDir);
 
-    float shadowBias = 0.001f;
-    std::vector<float> shadowRayOrigin = {
-        point[0] + shadowBias * lightDir[0],
-        point[1] + shadowBias * lightDir[1],
-        point[2] + shadowBias * lightDir[2]
-    };
-
-    Ray shadowRay(shadowRayOrigin, lightDir);
-
-    float t;
-    for (const auto &sphere : spheres)
-    {
-        if (sphere.intersectSphere(shadowRay, t))
-        {
-            return true;
-        }
-    }
+    return scene.spawnRay(hit, point, normal, lightDir);
+}
 
-    for (const auto &cylinder : cylinders)
-    {
-        if (cylinder.intersectCylinder(shadowRay, t))
-        {
-            return true;
-        }
-    }
-
-    for (const auto &triangle : triangles)
-    {
-        if (triangle.intersectTriangle(shadowRay, t))
-        {
-            return true;
-        }
-    }
-
-    return false;
+bool Shadow::isInShadow(const HitRecord& hit, const Vec3& point, const Vec3& normal, const Light& light, const Scene& scene)
+{
+    return scene.occluded(shadowRay(scene, hit, point, normal, light));
 }
\ No newline at end of file
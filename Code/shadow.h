@@ -3,14 +3,14 @@
 
 #include <vector>
 #include "light.h"
-#include "sphere.h"
-#include "cylinder.h"
-#include "triangle.h"
+#include "scene.h"
 
 class Shadow
 {
 public:
-    static bool isInShadow(const std::vector<float>& point, const Light& light, const std::vector<Sphere>& spheres, const std::vector<Cylinder>& cylinders, const std::vector<Triangle>& triangles);
+    // Ray from the surface point of hit towards the light.
+    static Ray shadowRay(const Scene& scene, const HitRecord& hit, const Vec3& point, const Vec3& normal, const Light& light);
+    static bool isInShadow(const HitRecord& hit, const Vec3& point, const Vec3& normal, const Light& light, const Scene& scene);
 };
 
 #endif
\ No newline at end of file
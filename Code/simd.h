@@ -0,0 +1,94 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Thin wrapper over the widest float SIMD unit the compiler targets, so the
+// batch intersection kernels can be written once. AVX gives 8 lanes, SSE2 gives
+// 4, and everything else (e.g. arm64 builds) falls back to a 1-lane scalar path.
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+typedef __m256 SimdFloat;
+const int kSimdWidth = 8;
+
+inline SimdFloat simdLoad(const float *p) { return _mm256_loadu_ps(p); }
+inline void simdStore(float *p, SimdFloat a) { _mm256_storeu_ps(p, a); }
+inline SimdFloat simdSet(float x) { return _mm256_set1_ps(x); }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a, b); }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a, b); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a, b); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a, b); }
+inline SimdFloat simdSqrt(SimdFloat a) { return _mm256_sqrt_ps(a); }
+inline SimdFloat simdCmpGt(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline SimdFloat simdCmpGe(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline SimdFloat simdCmpLe(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline SimdFloat simdCmpLt(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+inline SimdFloat simdOr(SimdFloat a, SimdFloat b) { return _mm256_or_ps(a, b); }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b, a, mask); }
+inline int simdMask(SimdFloat mask) { return _mm256_movemask_ps(mask); }
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+typedef __m128 SimdFloat;
+const int kSimdWidth = 4;
+
+inline SimdFloat simdLoad(const float *p) { return _mm_loadu_ps(p); }
+inline void simdStore(float *p, SimdFloat a) { _mm_storeu_ps(p, a); }
+inline SimdFloat simdSet(float x) { return _mm_set1_ps(x); }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a, b); }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return _mm_div_ps(a, b); }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a, b); }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a, b); }
+inline SimdFloat simdSqrt(SimdFloat a) { return _mm_sqrt_ps(a); }
+inline SimdFloat simdCmpGt(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a, b); }
+inline SimdFloat simdCmpGe(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a, b); }
+inline SimdFloat simdCmpLe(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a, b); }
+inline SimdFloat simdCmpLt(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a, b); }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+inline SimdFloat simdOr(SimdFloat a, SimdFloat b) { return _mm_or_ps(a, b); }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline int simdMask(SimdFloat mask) { return _mm_movemask_ps(mask); }
+
+#else
+
+#include <cmath>
+
+// Scalar fallback: a comparison "mask" is 1.0f for true and 0.0f for false.
+typedef float SimdFloat;
+const int kSimdWidth = 1;
+
+inline SimdFloat simdLoad(const float *p) { return *p; }
+inline void simdStore(float *p, SimdFloat a) { *p = a; }
+inline SimdFloat simdSet(float x) { return x; }
+inline SimdFloat simdAdd(SimdFloat a, SimdFloat b) { return a + b; }
+inline SimdFloat simdSub(SimdFloat a, SimdFloat b) { return a - b; }
+inline SimdFloat simdMul(SimdFloat a, SimdFloat b) { return a * b; }
+inline SimdFloat simdDiv(SimdFloat a, SimdFloat b) { return a / b; }
+inline SimdFloat simdMin(SimdFloat a, SimdFloat b) { return a < b ? a : b; }
+inline SimdFloat simdMax(SimdFloat a, SimdFloat b) { return a > b ? a : b; }
+inline SimdFloat simdSqrt(SimdFloat a) { return std::sqrt(a); }
+inline SimdFloat simdCmpGt(SimdFloat a, SimdFloat b) { return a > b ? 1.0f : 0.0f; }
+inline SimdFloat simdCmpGe(SimdFloat a, SimdFloat b) { return a >= b ? 1.0f : 0.0f; }
+inline SimdFloat simdCmpLe(SimdFloat a, SimdFloat b) { return a <= b ? 1.0f : 0.0f; }
+inline SimdFloat simdCmpLt(SimdFloat a, SimdFloat b) { return a < b ? 1.0f : 0.0f; }
+inline SimdFloat simdAnd(SimdFloat a, SimdFloat b) { return (a != 0.0f && b != 0.0f) ? 1.0f : 0.0f; }
+inline SimdFloat simdOr(SimdFloat a, SimdFloat b) { return (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; }
+inline SimdFloat simdSelect(SimdFloat mask, SimdFloat a, SimdFloat b) { return mask != 0.0f ? a : b; }
+inline int simdMask(SimdFloat mask) { return mask != 0.0f ? 1 : 0; }
+
+#endif
+
+// Bitmask with the lowest n lanes set, used to ignore lanes past the end of a range.
+inline int simdTailMask(int n) { return n >= kSimdWidth ? (1 << kSimdWidth) - 1 : (1 << n) - 1; }
+// Every lane except the one holding slot skip, for a batch starting at slot i.
+inline int simdSkipMask(int skip, int i) { return static_cast<unsigned>(skip - i) < static_cast<unsigned>(kSimdWidth) ? ~(1 << (skip - i)) : ~0; }
+
+#endif
@@ -0,0 +1,76 @@
+#include "specular_power.h"
+#include <algorithm>
+
+SpecularPower::SpecularPower(float exponent) : exponent(exponent), method(Method::Pow)
+{
+    if (exponent >= 0.0f && exponent <= kMaxSquaringExponent && exponent == std::floor(exponent))
+    {
+        method = Method::Squaring;
+        whole = static_cast<int>(exponent);
+    }
+    else if (exponent > 0.0f && std::isfinite(exponent))
+    {
+        // Sample only where the lobe is visible; a high exponent leaves a
+        // narrow band below 1 where all of it happens.
+        cutoff = std::pow(kMaxError / 4.0f, 1.0f / exponent);
+        table_scale = (kTableSize - 1) / (1.0f - cutoff);
+        if (!(cutoff < 1.0f) || !std::isfinite(table_scale))
+        {
+            // Past about 3e8 the band rounds away to nothing; std::pow
+            // still gives the delta-like lobe.
+            cutoff = 0.0f;
+            table_scale = 0.0f;
+            return;
+        }
+        method = Method::Table;
+        std::vector<float> entries(kTableSize);
+        for (int i = 0; i < kTableSize; ++i)
+        {
+            entries[i] = std::pow(cutoff + i / table_scale, exponent);
+        }
+        entries[0] = 0.0f;
+        entries[kTableSize - 1] = 1.0f;
+        table = std::make_shared<const std::vector<float>>(std::move(entries));
+    }
+    if (method == Method::Pow)
+    {
+        return;
+    }
+
+    max_error = measureError();
+    if (!(max_error <= kMaxError))
+    {
+        // Low exponents bend too sharply near zero for the table to follow.
+        method = Method::Pow;
+        table.reset();
+        max_error = 0.0f;
+    }
+}
+
+// Checks all of [0, 1] evenly, and the table range at four points per
+// interval, one of them the midpoint, where linear interpolation is furthest
+// off.
+float SpecularPower::measureError() const
+{
+    std::vector<float> points;
+    const int samples = 4 * kTableSize;
+    for (int i = 0; i <= samples; ++i)
+    {
+        points.push_back(static_cast<float>(i) / samples);
+    }
+    if (method == Method::Table)
+    {
+        for (int i = 0; i <= 4 * (kTableSize - 1); ++i)
+        {
+            points.push_back(std::min(cutoff + i / (4.0f * table_scale), 1.0f));
+        }
+    }
+
+    double worst = 0.0;
+    for (float x : points)
+    {
+        double exact = std::pow(static_cast<double>(x), static_cast<double>(exponent));
+        worst = std::max(worst, std::fabs((*this)(x) - exact));
+    }
+    return static_cast<float>(worst);
+}
@@ -0,0 +1,80 @@
+#ifndef SPECULAR_POWER_H
+#define SPECULAR_POWER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// pow(x, exponent) for the Blinn-Phong highlight, x = max(N.H, 0) in [0, 1].
+// The method is picked once per exponent: repeated squaring for small whole
+// exponents, a lookup table otherwise, and std::pow whenever the faster one
+// strays more than kMaxError from it over [0, 1]. Past a few squarings the
+// table is the cheaper of the two, integer exponent or not.
+class SpecularPower
+{
+public:
+    enum class Method : uint8_t
+    {
+        Squaring,
+        Table,
+        Pow
+    };
+
+    // Well under one step of an 8-bit channel.
+    static constexpr float kMaxError = 1.0f / 4096.0f;
+    static const int kMaxSquaringExponent = 4;
+    static const int kTableSize = 1024;
+
+    SpecularPower() = default;
+    explicit SpecularPower(float exponent);
+
+    float operator()(float x) const
+    {
+        switch (method)
+        {
+        case Method::Squaring:
+        {
+            float result = 1.0f;
+            for (int n = whole; n > 0; n >>= 1)
+            {
+                result *= (n & 1) ? x : 1.0f;
+                x *= x;
+            }
+            return result;
+        }
+        case Method::Table:
+        {
+            // The first entry is zero, which the tail below cutoff is
+            // clamped to. Operand order sends a NaN x there too.
+            float position = std::min(std::max(0.0f, (x - cutoff) * table_scale), static_cast<float>(kTableSize - 1));
+            int index = std::min(static_cast<int>(position), kTableSize - 2);
+            float fraction = position - index;
+            const float *entries = table->data() + index;
+            return entries[0] + (entries[1] - entries[0]) * fraction;
+        }
+        default:
+            return std::pow(x, exponent);
+        }
+    }
+
+    Method getMethod() const { return method; }
+    // Largest difference from std::pow found when the method was chosen.
+    float getMaxError() const { return max_error; }
+
+private:
+    float measureError() const;
+
+    float exponent = 0.0f;
+    Method method = Method::Squaring;
+    int whole = 0;
+    // Below cutoff the lobe is under kMaxError / 4 and the table returns zero.
+    float cutoff = 0.0f;
+    float table_scale = 0.0f;
+    // Shared so copies of a material, e.g. one per mesh triangle, keep one table.
+    std::shared_ptr<const std::vector<float>> table;
+    float max_error = 0.0f;
+};
+
+#endif
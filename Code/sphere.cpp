@@ -5,40 +5,48 @@
 Sphere::Sphere(const std::vector<float> center, float radius, Material material)
     : center(center), radius(radius), material(material) {}
 
+// Ray directions are normalized, so a = 1 and the half-b form needs a single
+// sqrt and no division.
 float Sphere::find_root(const Ray &ray) const
 {
-    std::vector<float> oc = {ray.origin[0] - center[0], ray.origin[1] - center[1], ray.origin[2] - center[2]};
-    float a = ray.direction[0] * ray.direction[0] + ray.direction[1] * ray.direction[1] + ray.direction[2] * ray.direction[2];
-    float b = 2.0f * (ray.direction[0] * oc[0] + ray.direction[1] * oc[1] + ray.direction[2] * oc[2]);
+    float oc[3] = {ray.origin[0] - center[0], ray.origin[1] - center[1], ray.origin[2] - center[2]};
+    float b = ray.direction[0] * oc[0] + ray.direction[1] * oc[1] + ray.direction[2] * oc[2];
     float c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - radius * radius;
-    float discriminant = b * b - 4 * a * c;
+    float discriminant = b * b - c;
     if (discriminant < 0)
     {
         return -1.0f;
     }
-    
-    float root1 = (-b - sqrt(discriminant)) / (2.0f * a);
-    float root2 = (-b + sqrt(discriminant)) / (2.0f * a);
 
-    if (root1 > 0 && root2 > 0)
+    float s = sqrt(discriminant);
+    float root = -b - s;
+    if (root > ray.t_min)
     {
-        return std::min(root1, root2);
+        return root;
     }
-    else if (root1 > 0)
+    root = -b + s;
+    if (root > ray.t_min)
     {
-        return root1;
+        return root;
     }
-    else if (root2 > 0)
+    return -1.0f;
+}
+
+Aabb Sphere::bounds() const
+{
+    Aabb box;
+    for (int i = 0; i < 3; ++i)
     {
-        return root2;
+        box.min[i] = center[i] - radius;
+        box.max[i] = center[i] + radius;
     }
-    return -1.0f;
+    return box;
 }
 
 bool Sphere::intersectSphere(const Ray &ray, float &t) const
 {
     float root = find_root(ray);
-    if (root < 0)
+    if (root < 0 || root >= ray.t_max)
     {
         return false;
     }
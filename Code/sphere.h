@@ -3,6 +3,7 @@
 
 #include "ray.h"
 #include "material.h"
+#include "aabb.h"
 #include <vector>
 
 class Sphere{
@@ -10,6 +11,7 @@ class Sphere{
         Sphere(const std::vector<float> center, float radius, Material material);
         bool intersectSphere(const Ray& ray, float& t) const;
         float find_root(const Ray& ray) const;
+        Aabb bounds() const;
         std::vector<float> center;
         float radius;
         Material material;
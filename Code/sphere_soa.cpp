@@ -0,0 +1,107 @@
+#include "sphere_soa.h"
+#include "simd.h"
+#include <limits>
+
+void SphereSoA::build(const std::vector<Sphere> &spheres, const std::vector<int> &order)
+{
+    count = static_cast<int>(order.size());
+
+    // Pad by a full SIMD width so a batch starting at any slot can be loaded
+    // unmasked; padding spheres have r^2 = -inf and can never be hit.
+    size_t padded = order.size() + kSimdWidth;
+    cx.assign(padded, 0.0f);
+    cy.assign(padded, 0.0f);
+    cz.assign(padded, 0.0f);
+    r2.assign(padded, -std::numeric_limits<float>::infinity());
+    sphere_index = order;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Sphere &sphere = spheres[order[i]];
+        cx[i] = sphere.center[0];
+        cy[i] = sphere.center[1];
+        cz[i] = sphere.center[2];
+        r2[i] = sphere.radius * sphere.radius;
+    }
+}
+
+// Ray directions are normalized everywhere in the renderer, so the quadratic
+// reduces to t = -b -+ sqrt(b^2 - c) with b = oc.d and c = oc.oc - r^2. Lanes
+// report the nearest root inside (t_min, t_max).
+static inline int intersectBatch(const float *cx, const float *cy, const float *cz, const float *r2,
+                                 SimdFloat ox, SimdFloat oy, SimdFloat oz,
+                                 SimdFloat dx, SimdFloat dy, SimdFloat dz,
+                                 SimdFloat t_min, SimdFloat t_max, SimdFloat &t)
+{
+    SimdFloat ocx = simdSub(ox, simdLoad(cx));
+    SimdFloat ocy = simdSub(oy, simdLoad(cy));
+    SimdFloat ocz = simdSub(oz, simdLoad(cz));
+
+    SimdFloat b = simdAdd(simdAdd(simdMul(ocx, dx), simdMul(ocy, dy)), simdMul(ocz, dz));
+    SimdFloat c = simdSub(simdAdd(simdAdd(simdMul(ocx, ocx), simdMul(ocy, ocy)), simdMul(ocz, ocz)), simdLoad(r2));
+    SimdFloat discriminant = simdSub(simdMul(b, b), c);
+
+    SimdFloat zero = simdSet(0.0f);
+    SimdFloat valid = simdCmpGe(discriminant, zero);
+    SimdFloat s = simdSqrt(simdMax(discriminant, zero));
+    SimdFloat near_root = simdSub(simdSub(zero, b), s);
+    SimdFloat far_root = simdAdd(simdSub(zero, b), s);
+
+    t = simdSelect(simdCmpGt(near_root, t_min), near_root, far_root);
+    return simdMask(simdAnd(valid, simdAnd(simdCmpGt(t, t_min), simdCmpLt(t, t_max))));
+}
+
+int SphereSoA::closestHit(const Ray &ray, int begin, int end, int skip, float &t) const
+{
+    SimdFloat ox = simdSet(ray.origin[0]), oy = simdSet(ray.origin[1]), oz = simdSet(ray.origin[2]);
+    SimdFloat dx = simdSet(ray.direction[0]), dy = simdSet(ray.direction[1]), dz = simdSet(ray.direction[2]);
+    SimdFloat t_min = simdSet(ray.t_min), t_max = simdSet(ray.t_max);
+
+    int closest = -1;
+    float closestT = ray.t_max;
+    float lanes[kSimdWidth];
+
+    for (int i = begin; i < end; i += kSimdWidth)
+    {
+        SimdFloat roots;
+        int mask = intersectBatch(&cx[i], &cy[i], &cz[i], &r2[i], ox, oy, oz, dx, dy, dz, t_min, t_max, roots);
+        mask &= simdTailMask(end - i) & simdSkipMask(skip, i);
+        if (!mask)
+        {
+            continue;
+        }
+        simdStore(lanes, roots);
+        for (int lane = 0; lane < kSimdWidth; ++lane)
+        {
+            if ((mask >> lane) & 1 && lanes[lane] < closestT)
+            {
+                closestT = lanes[lane];
+                closest = i + lane;
+            }
+        }
+    }
+
+    if (closest >= 0)
+    {
+        t = closestT;
+    }
+    return closest;
+}
+
+bool SphereSoA::anyHit(const Ray &ray, int begin, int end, int skip) const
+{
+    SimdFloat ox = simdSet(ray.origin[0]), oy = simdSet(ray.origin[1]), oz = simdSet(ray.origin[2]);
+    SimdFloat dx = simdSet(ray.direction[0]), dy = simdSet(ray.direction[1]), dz = simdSet(ray.direction[2]);
+    SimdFloat t_min = simdSet(ray.t_min), t_max = simdSet(ray.t_max);
+
+    for (int i = begin; i < end; i += kSimdWidth)
+    {
+        SimdFloat roots;
+        int mask = intersectBatch(&cx[i], &cy[i], &cz[i], &r2[i], ox, oy, oz, dx, dy, dz, t_min, t_max, roots);
+        if (mask & simdTailMask(end - i) & simdSkipMask(skip, i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
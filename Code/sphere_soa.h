@@ -0,0 +1,30 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include <vector>
+#include "ray.h"
+#include "sphere.h"
+
+// Structure-of-arrays copy of the sphere set (cx, cy, cz, r^2) used by the SIMD
+// batch intersection kernels. Slots refer to positions in these arrays;
+// sphere_index maps a slot back to the source sphere vector.
+class SphereSoA
+{
+public:
+    void build(const std::vector<Sphere> &spheres, const std::vector<int> &order);
+    // Both skip slot skip, the primitive a ray starts on (-1 for none).
+    int closestHit(const Ray &ray, int begin, int end, int skip, float &t) const;
+    bool anyHit(const Ray &ray, int begin, int end, int skip) const;
+    int size() const { return count; }
+
+    std::vector<float> cx;
+    std::vector<float> cy;
+    std::vector<float> cz;
+    std::vector<float> r2;
+    std::vector<int> sphere_index;
+
+private:
+    int count = 0;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <iterator>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int threads)
+{
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+int ThreadPool::currentWorker()
+{
+    return current_worker;
+}
+
+bool ThreadPool::pinWorker(int worker, const std::vector<int> &cpus)
+{
+    return pinThread(workers[worker], cpus);
+}
+
+#ifdef __linux__
+static bool setAffinity(pthread_t thread, const std::vector<int> &cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool pinThread(std::thread &thread, const std::vector<int> &cpus)
+{
+    return setAffinity(thread.native_handle(), cpus);
+}
+
+bool pinCurrentThread(const std::vector<int> &cpus)
+{
+    return setAffinity(pthread_self(), cpus);
+}
+#else
+bool pinThread(std::thread &, const std::vector<int> &)
+{
+    return false;
+}
+
+bool pinCurrentThread(const std::vector<int> &)
+{
+    return false;
+}
+#endif
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task, const TaskGroup *group)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back({std::move(task), group});
+    }
+    available.notify_one();
+}
+
+bool ThreadPool::runPendingTask(const TaskGroup *group)
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = std::find_if(tasks.rbegin(), tasks.rend(), [group](const Task &queued) { return queued.group == group; });
+        if (found == tasks.rend())
+        {
+            return false;
+        }
+        task = std::move(found->run);
+        tasks.erase(std::next(found).base());
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    current_worker = index;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            available.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front().run);
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+    }
+    pool.submit([this, task = std::move(task)] {
+        // Counts the task as done however it ends, or wait() would sleep
+        // forever. The count drops under the lock, so the group outlives the
+        // notification; the error is stored first, while it still exists.
+        struct Done
+        {
+            TaskGroup &group;
+            ~Done()
+            {
+                std::lock_guard<std::mutex> lock(group.mutex);
+                if (--group.pending == 0)
+                {
+                    group.changed.notify_all();
+                }
+            }
+        } done{*this};
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }, this);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++submitted;
+    }
+    changed.notify_all();
+}
+
+// Tasks of other groups are left to the workers: running one inline would
+// hold this wait until that unrelated work finished. A task queued after the
+// scan bumps submitted, so the waiter scans again rather than sleeping.
+void TaskGroup::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pending > 0)
+    {
+        unsigned seen = submitted;
+        lock.unlock();
+        while (pool.runPendingTask(this))
+        {
+        }
+        lock.lock();
+        if (pending > 0 && submitted == seen)
+        {
+            changed.wait(lock);
+        }
+    }
+}
+
+void TaskGroup::wait()
+{
+    drain();
+    std::exception_ptr first;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(first, error);
+    }
+    if (first)
+    {
+        std::rethrow_exception(first);
+    }
+}
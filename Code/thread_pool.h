@@ -0,0 +1,111 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Fixed set of worker threads fed from one task queue. Threads that wait on a
+// TaskGroup run that group's queued tasks themselves, so nested parallelism (a
+// task that spawns and waits for subtasks) cannot deadlock the pool.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Process-wide pool sized to the hardware, created on first use.
+    static ThreadPool &shared();
+
+    int size() const { return static_cast<int>(workers.size()); }
+    // Index of the calling thread within its pool, or -1 outside any pool.
+    static int currentWorker();
+    bool pinWorker(int worker, const std::vector<int> &cpus);
+    void submit(std::function<void()> task, const TaskGroup *group = nullptr);
+    // Runs the most recently queued task of group, if any is still queued.
+    bool runPendingTask(const TaskGroup *group);
+
+private:
+    struct Task
+    {
+        std::function<void()> run;
+        const TaskGroup *group;
+    };
+
+    void workerLoop(int index);
+
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+};
+
+// Restricts a thread to the given CPUs. Linux only; elsewhere returns false
+// and leaves scheduling to the OS.
+bool pinThread(std::thread &thread, const std::vector<int> &cpus);
+bool pinCurrentThread(const std::vector<int> &cpus);
+
+// Tasks run on the pool; wait() returns once all of them have finished and
+// rethrows the first exception any of them threw. A waiting thread helps with
+// the group's own queued tasks and otherwise sleeps until they finish.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool &pool) : pool(pool) {}
+    // Waits without rethrowing; call wait() to see task errors.
+    ~TaskGroup() { drain(); }
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    void drain();
+
+    ThreadPool &pool;
+    // Guards everything below; finished or queued tasks signal changed.
+    std::mutex mutex;
+    std::condition_variable changed;
+    int pending = 0;
+    unsigned submitted = 0;
+    std::exception_ptr error;
+};
+
+// Calls fn(begin, end) on sub-ranges of [begin, end) no smaller than grain.
+template <typename Fn>
+void parallelFor(ThreadPool &pool, size_t begin, size_t end, size_t grain, Fn fn)
+{
+    size_t count = end - begin;
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(count / std::max<size_t>(grain, 1), 4 * (pool.size() + 1)));
+    if (chunks <= 1)
+    {
+        if (count > 0)
+        {
+            fn(begin, end);
+        }
+        return;
+    }
+
+    TaskGroup group(pool);
+    for (size_t chunk = 1; chunk < chunks; ++chunk)
+    {
+        size_t first = begin + count * chunk / chunks;
+        size_t last = begin + count * (chunk + 1) / chunks;
+        group.run([=, &fn] { fn(first, last); });
+    }
+    fn(begin, begin + count / chunks);
+    group.wait();
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include "tile_scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+bool parseTileOrder(const std::string &name, TileOrder &order)
+{
+    if (name == "scanline")
+    {
+        order = TileOrder::Scanline;
+    }
+    else if (name == "morton")
+    {
+        order = TileOrder::Morton;
+    }
+    else if (name == "hilbert")
+    {
+        order = TileOrder::Hilbert;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *tileOrderName(TileOrder order)
+{
+    switch (order)
+    {
+    case TileOrder::Scanline:
+        return "scanline";
+    case TileOrder::Morton:
+        return "morton";
+    default:
+        return "hilbert";
+    }
+}
+
+static uint32_t mortonIndex(uint32_t x, uint32_t y)
+{
+    uint32_t index = 0;
+    for (int bit = 0; bit < 16; ++bit)
+    {
+        index |= ((x >> bit) & 1u) << (2 * bit);
+        index |= ((y >> bit) & 1u) << (2 * bit + 1);
+    }
+    return index;
+}
+
+// Position along the Hilbert curve filling an n x n grid (n a power of two).
+static uint32_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint32_t index = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        index += s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+void orderTiles(std::vector<ImageRegion> &tiles, int tile_size, TileOrder order)
+{
+    if (order == TileOrder::Scanline || tiles.empty())
+    {
+        return;
+    }
+
+    uint32_t grid = 1;
+    for (const auto &tile : tiles)
+    {
+        while (grid <= static_cast<uint32_t>(std::max(tile.x0, tile.y0) / tile_size))
+        {
+            grid *= 2;
+        }
+    }
+
+    std::vector<std::pair<uint32_t, size_t>> keys(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        uint32_t x = static_cast<uint32_t>(tiles[i].x0 / tile_size);
+        uint32_t y = static_cast<uint32_t>(tiles[i].y0 / tile_size);
+        keys[i] = {order == TileOrder::Morton ? mortonIndex(x, y) : hilbertIndex(grid, x, y), i};
+    }
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::vector<ImageRegion> sorted(tiles.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        sorted[i] = tiles[keys[i].second];
+    }
+    tiles.swap(sorted);
+}
+
+namespace
+{
+// A participant's remaining slice [begin, end). The owner takes from the
+// front, thieves take from the back.
+struct alignas(64) Slice
+{
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+};
+} // namespace
+
+std::vector<WorkerStats> TileScheduler::run(size_t count, const std::function<void(size_t)> &fn)
+{
+    int participants = pool.size() + 1;
+    std::unique_ptr<Slice[]> slices(new Slice[participants]);
+    for (int p = 0; p < participants; ++p)
+    {
+        slices[p].begin = count * p / participants;
+        slices[p].end = count * (p + 1) / participants;
+    }
+    std::vector<WorkerStats> stats(participants);
+
+    auto participate = [&](int self) {
+        WorkerStats &mine = stats[self];
+        while (true)
+        {
+            size_t item;
+            {
+                std::lock_guard<std::mutex> lock(slices[self].mutex);
+                item = slices[self].begin < slices[self].end ? slices[self].begin++ : count;
+            }
+
+            if (item == count)
+            {
+                // Steal the back half of the fullest slice; stop when all are empty.
+                int victim = -1;
+                size_t most = 0;
+                for (int p = 0; p < participants; ++p)
+                {
+                    std::lock_guard<std::mutex> lock(slices[p].mutex);
+                    if (p != self && slices[p].end - slices[p].begin > most)
+                    {
+                        most = slices[p].end - slices[p].begin;
+                        victim = p;
+                    }
+                }
+                if (victim < 0)
+                {
+                    return;
+                }
+
+                size_t stolen_begin, stolen_end;
+                {
+                    std::lock_guard<std::mutex> lock(slices[victim].mutex);
+                    size_t remaining = slices[victim].end - slices[victim].begin;
+                    if (remaining == 0)
+                    {
+                        continue;
+                    }
+                    stolen_end = slices[victim].end;
+                    stolen_begin = stolen_end - (remaining + 1) / 2;
+                    slices[victim].end = stolen_begin;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(slices[self].mutex);
+                    slices[self].begin = stolen_begin + 1;
+                    slices[self].end = stolen_end;
+                }
+                item = stolen_begin;
+                ++mine.steals;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            fn(item);
+            mine.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            ++mine.tiles;
+        }
+    };
+
+    auto run_start = std::chrono::steady_clock::now();
+    {
+        TaskGroup group(pool);
+        for (int p = 1; p < participants; ++p)
+        {
+            group.run([&participate, p] { participate(p); });
+        }
+        participate(0);
+        group.wait();
+    }
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    for (auto &worker : stats)
+    {
+        worker.idle_seconds = std::max(0.0, total - worker.busy_seconds);
+    }
+    return stats;
+}
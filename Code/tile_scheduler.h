@@ -0,0 +1,48 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "image_region.h"
+#include "thread_pool.h"
+
+enum class TileOrder
+{
+    Scanline,
+    Morton,
+    Hilbert
+};
+
+bool parseTileOrder(const std::string &name, TileOrder &order);
+const char *tileOrderName(TileOrder order);
+
+// Sorts tiles along a space-filling curve over the tile grid so that tiles
+// rendered one after another are spatial neighbours and touch the same geometry.
+void orderTiles(std::vector<ImageRegion> &tiles, int tile_size, TileOrder order);
+
+struct WorkerStats
+{
+    double busy_seconds = 0.0;
+    double idle_seconds = 0.0;
+    int tiles = 0;
+    int steals = 0;
+};
+
+// Runs fn(i) for every i in [0, count) on the pool workers and the calling
+// thread. Each participant starts with a contiguous slice of the order and,
+// once it runs dry, steals the back half of the largest remaining slice, so
+// expensive tiles cannot leave the other threads idle. Returns one entry per
+// participant; idle time is the part of the whole run it spent not rendering.
+class TileScheduler
+{
+public:
+    explicit TileScheduler(ThreadPool &pool) : pool(pool) {}
+    std::vector<WorkerStats> run(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+    ThreadPool &pool;
+};
+
+#endif
@@ -8,35 +8,217 @@
 #include <limits>
 #include <iostream>
 #include <algorithm>
+#include <map>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include <cstdio>
+#include <sys/stat.h>
 #include "material.h"
 #include "binary_shader.h"
 #include "blinn_phong_shader.h"
 #include "vector_utils.h"
 #include "tone_mapping.h"
 #include "shadow.h"
+#include "mesh_loader.h"
+#include "thread_pool.h"
+#include "checkpoint.h"
+#include "random.h"
+#include "numa.h"
+#include "arena.h"
+#include "alloc_counter.h"
+#include "wavefront.h"
 
 using json = nlohmann::json;
 
 float pi = 3.14159265358979323846;
 
+// Secondary rays the calling thread has traced and pruned; render() reads
+// them per tile, like the heap allocation counter.
+static thread_local uint64_t thread_secondary_rays = 0;
+static thread_local uint64_t thread_pruned_rays = 0;
+
+// Materials are numbered in the order they appear in the scene file.
+static Material parseMaterial(const json &material, int &material_count)
+{
+    float ks_coeffcient = material["ks"].get<float>();
+    float kd_coeffcient = material["kd"].get<float>();
+    float specular_exponent = material["specularexponent"].get<float>();
+    std::vector<float> diffuse_color = material["diffusecolor"].get<std::vector<float>>();
+    std::vector<float> specular_color = material["specularcolor"].get<std::vector<float>>();
+    bool is_reflective = material["isreflective"].get<bool>();
+    float reflectivity = material["reflectivity"].get<float>();
+    bool is_refractive = material["isrefractive"].get<bool>();
+    float refractive_index = material["refractiveindex"].get<float>();
+
+    Material result(ks_coeffcient, kd_coeffcient, specular_exponent, diffuse_color, specular_color, is_reflective, reflectivity, is_refractive, refractive_index);
+    result.id = material_count++;
+    return result;
+}
+
+// FNV-1a, for a checkpoint key that stays the same across builds.
+static uint64_t hashBytes(uint64_t hash, const std::string &bytes)
+{
+    for (unsigned char byte : bytes)
+    {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Meshes are too large to hash on every load, so their size and modification
+// time stand in for their contents.
+static uint64_t hashFileStamp(uint64_t hash, const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return hashBytes(hash, path);
+    }
+    return hashBytes(hash, path + ":" + std::to_string(info.st_size) + ":" + std::to_string(info.st_mtime));
+}
+
+static void parseShape(const json &shape, GeometryGroup &group, const std::string &base_directory, int &material_count, uint64_t &scene_hash)
+{
+    std::string type = shape["type"].get<std::string>();
+    if (type == "sphere")
+    {
+        std::vector<float> center = {shape["center"][0].get<float>(), shape["center"][1].get<float>(), shape["center"][2].get<float>()};
+        float radius = shape["radius"].get<float>();
+        group.spheres.emplace_back(center, radius, parseMaterial(shape["material"], material_count));
+    }
+    if (type == "cylinder")
+    {
+        std::vector<float> center = {shape["center"][0].get<float>(), shape["center"][1].get<float>(), shape["center"][2].get<float>()};
+        float radius = shape["radius"].get<float>();
+        std::vector<float> axis = {shape["axis"][0].get<float>(), shape["axis"][1].get<float>(), shape["axis"][2].get<float>()};
+        float height = shape["height"].get<float>();
+        group.cylinders.emplace_back(center, radius, axis, height, parseMaterial(shape["material"], material_count));
+    }
+    if (type == "triangle")
+    {
+        std::vector<float> v0 = {shape["v0"][0].get<float>(), shape["v0"][1].get<float>(), shape["v0"][2].get<float>()};
+        std::vector<float> v1 = {shape["v1"][0].get<float>(), shape["v1"][1].get<float>(), shape["v1"][2].get<float>()};
+        std::vector<float> v2 = {shape["v2"][0].get<float>(), shape["v2"][1].get<float>(), shape["v2"][2].get<float>()};
+        group.triangles.emplace_back(v0, v1, v2, parseMaterial(shape["material"], material_count));
+    }
+    if (type == "mesh")
+    {
+        // Mesh paths are relative to the scene file unless absolute.
+        std::string file = shape["file"].get<std::string>();
+        if (!file.empty() && file[0] != '/')
+        {
+            file = base_directory + file;
+        }
+        scene_hash = hashFileStamp(scene_hash, file);
+        MeshLoader::load(file, parseMaterial(shape["material"], material_count), group.triangles);
+    }
+}
+
+static void parseVector3(const json &value, const std::string &name, float out[3])
+{
+    std::vector<float> vector = value.get<std::vector<float>>();
+    if (vector.size() != 3)
+    {
+        throw std::runtime_error("Instance " + name + " must have 3 entries");
+    }
+    std::copy(vector.begin(), vector.end(), out);
+}
+
+// Instance placement: either an explicit row-major "matrix" (3x4 or 4x4) or
+// any of "translate", "rotate" (degrees about x, y, z) and "scale", applied as
+// T * Rz * Ry * Rx * S.
+static TransformKeyframe parseTransformKeyframe(const json &shape)
+{
+    TransformKeyframe key;
+    if (shape.contains("frame"))
+    {
+        key.frame = shape["frame"].get<float>();
+    }
+    if (shape.contains("translate"))
+    {
+        parseVector3(shape["translate"], "translate", key.translate);
+    }
+    if (shape.contains("rotate"))
+    {
+        parseVector3(shape["rotate"], "rotate", key.rotate);
+    }
+    if (shape.contains("scale"))
+    {
+        if (shape["scale"].is_number())
+        {
+            std::fill(key.scale, key.scale + 3, shape["scale"].get<float>());
+        }
+        else
+        {
+            parseVector3(shape["scale"], "scale", key.scale);
+        }
+    }
+    return key;
+}
+
+static void parseTransform(const json &shape, float transform[12])
+{
+    if (shape.contains("matrix"))
+    {
+        std::vector<float> matrix = shape["matrix"].get<std::vector<float>>();
+        if (matrix.size() != 12 && matrix.size() != 16)
+        {
+            throw std::runtime_error("Instance matrix must have 12 or 16 entries");
+        }
+        std::copy(matrix.begin(), matrix.begin() + 12, transform);
+        return;
+    }
+
+    TransformKeyframe key = parseTransformKeyframe(shape);
+    composeTransform(key.translate, key.rotate, key.scale, transform);
+}
+
 void Tools::readConfig(const std::string &filename)
 {
     std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Could not open scene file " + filename);
+    }
     json j;
     file >> j;
 
+    std::string base_directory = filename.substr(0, filename.find_last_of('/') + 1);
+    scene_file = filename;
+    // The parsed description covers lights, materials, geometry, camera and
+    // background, whatever the file's formatting.
+    scene_hash = hashBytes(14695981039346656037ull, j.dump());
+
     nbounces = j["nbounces"];
     rendermode = j["rendermode"];
-    camera_type = j["camera"]["type"];
-    width = j["camera"]["width"].get<int>();
-    height = j["camera"]["height"].get<int>();
-    position = j["camera"]["position"].get<std::vector<float>>();
-    lookAt = j["camera"]["lookAt"].get<std::vector<float>>();
-    upVector = j["camera"]["upVector"].get<std::vector<float>>();
-    fov = j["camera"]["fov"].get<float>();
-    exposure = j["camera"]["exposure"].get<float>();
+    tile_size = std::max(1, j.value("tilesize", tile_size));
+    if (j.contains("tileorder") && !parseTileOrder(j["tileorder"].get<std::string>(), tile_order))
+    {
+        throw std::runtime_error("Unknown tile order '" + j["tileorder"].get<std::string>() + "'");
+    }
+    std::string pipeline = j.value("pipeline", std::string(wavefront ? "wavefront" : "recursive"));
+    if (pipeline != "wavefront" && pipeline != "recursive")
+    {
+        throw std::runtime_error("Unknown pipeline '" + pipeline + "'");
+    }
+    wavefront = pipeline == "wavefront";
+    sort_secondary = j.value("sortsecondary", sort_secondary);
+    min_contribution = j.value("mincontribution", min_contribution);
+    camera.type = j["camera"]["type"];
+    camera.width = j["camera"]["width"].get<int>();
+    camera.height = j["camera"]["height"].get<int>();
+    camera.position = j["camera"]["position"].get<std::vector<float>>();
+    camera.lookAt = j["camera"]["lookAt"].get<std::vector<float>>();
+    camera.upVector = j["camera"]["upVector"].get<std::vector<float>>();
+    camera.fov = j["camera"]["fov"].get<float>();
+    camera.exposure = j["camera"]["exposure"].get<float>();
+    camera.samples = std::max(1, j["camera"].value("samples", 1));
+    camera.seed = j["camera"].value("seed", 0u);
 
-    backgroundcolor = j["scene"]["backgroundcolor"].get<std::vector<float>>();
+    std::vector<float> background = j["scene"]["backgroundcolor"].get<std::vector<float>>();
+    backgroundcolor = {background[0], background[1], background[2]};
 
     for (const auto &light : j["scene"]["lightsources"])
     {
@@ -47,116 +229,154 @@ void Tools::readConfig(const std::string &filename)
         lightsources.emplace_back(light_type, light_position, intensity);
     }
 
-    for (const auto &shape : j["scene"]["shapes"])
+    std::map<std::string, int> group_ids;
+    std::map<std::string, int> instance_ids;
+    material_count = 0;
+    if (j["scene"].contains("groups"))
     {
-        if (shape["type"].get<std::string>() == "sphere")
+        for (const auto &group_config : j["scene"]["groups"])
         {
-            std::vector<float> center = {shape["center"][0].get<float>(), shape["center"][1].get<float>(), shape["center"][2].get<float>()};
-            float radius = shape["radius"].get<float>();
-            float ks_coeffcient = shape["material"]["ks"].get<float>();
-            float kd_coeffcient = shape["material"]["kd"].get<float>();
-            float specular_exponent = shape["material"]["specularexponent"].get<float>();
-            std::vector<float> diffuse_color = shape["material"]["diffusecolor"].get<std::vector<float>>();
-            std::vector<float> specular_color = shape["material"]["specularcolor"].get<std::vector<float>>();
-            bool is_reflective = shape["material"]["isreflective"].get<bool>();
-            float reflectivity = shape["material"]["reflectivity"].get<float>();
-            bool is_refractive = shape["material"]["isrefractive"].get<bool>();
-            float refractive_index = shape["material"]["refractiveindex"].get<float>();
-
-            Material material(ks_coeffcient, kd_coeffcient, specular_exponent, diffuse_color, specular_color, is_reflective, reflectivity, is_refractive, refractive_index);
-
-            spheres.emplace_back(center, radius, material);
+            GeometryGroup group;
+            for (const auto &shape : group_config["shapes"])
+            {
+                parseShape(shape, group, base_directory, material_count, scene_hash);
+            }
+            group_ids[group_config["name"].get<std::string>()] = static_cast<int>(scene->groups.size());
+            scene->groups.push_back(std::move(group));
         }
-        if (shape["type"].get<std::string>() == "cylinder")
-        {
-            std::vector<float> center = {shape["center"][0].get<float>(), shape["center"][1].get<float>(), shape["center"][2].get<float>()};
-            float radius = shape["radius"].get<float>();
-            std::vector<float> axis = {shape["axis"][0].get<float>(), shape["axis"][1].get<float>(), shape["axis"][2].get<float>()};
-            float height = shape["height"].get<float>();
-            float ks_coeffcient = shape["material"]["ks"].get<float>();
-            float kd_coeffcient = shape["material"]["kd"].get<float>();
-            float specular_exponent = shape["material"]["specularexponent"].get<float>();
-            std::vector<float> diffuse_color = shape["material"]["diffusecolor"].get<std::vector<float>>();
-            std::vector<float> specular_color = shape["material"]["specularcolor"].get<std::vector<float>>();
-            bool is_reflective = shape["material"]["isreflective"].get<bool>();
-            float reflectivity = shape["material"]["reflectivity"].get<float>();
-            bool is_refractive = shape["material"]["isrefractive"].get<bool>();
-            float refractive_index = shape["material"]["refractiveindex"].get<float>();
+    }
 
-            Material material(ks_coeffcient, kd_coeffcient, specular_exponent, diffuse_color, specular_color, is_reflective, reflectivity, is_refractive, refractive_index);
+    for (const auto &shape : j["scene"]["shapes"])
+    {
+        if (shape["type"].get<std::string>() == "instance")
+        {
+            std::string group_name = shape["group"].get<std::string>();
+            auto group = group_ids.find(group_name);
+            if (group == group_ids.end())
+            {
+                throw std::runtime_error("Instance references unknown group '" + group_name + "'");
+            }
+            float transform[12];
+            parseTransform(shape, transform);
+            Instance instance(group->second, transform);
+            if (shape.contains("material"))
+            {
+                instance.has_material = true;
+                instance.material = parseMaterial(shape["material"], material_count);
+            }
+            if (shape.contains("name"))
+            {
+                instance_ids[shape["name"].get<std::string>()] = static_cast<int>(scene->instances.size());
+            }
+            scene->instances.push_back(instance);
+            continue;
+        }
+        parseShape(shape, scene->shapes, base_directory, material_count, scene_hash);
+    }
 
-            cylinders.emplace_back(center, radius, axis, height, material);
+    // Camera keyframes fall back to the static camera for fields they omit;
+    // instance tracks refer to instances by their "name".
+    if (j.contains("animation"))
+    {
+        const json &config = j["animation"];
+        animation.first_frame = config.value("startframe", 0);
+        animation.last_frame = config["endframe"].get<int>();
+        animation.output = config.value("output", animation.output);
+        animation.rebuild_threshold = config.value("rebuildthreshold", animation.rebuild_threshold);
+        if (config.contains("camera"))
+        {
+            for (const auto &key : config["camera"])
+            {
+                animation.camera.push_back({key["frame"].get<float>(),
+                                            key.value("position", camera.position),
+                                            key.value("lookAt", camera.lookAt),
+                                            key.value("fov", camera.fov)});
+            }
         }
-        if (shape["type"].get<std::string>() == "triangle")
+        if (config.contains("instances"))
         {
-            std::vector<float> v0 = {shape["v0"][0].get<float>(), shape["v0"][1].get<float>(), shape["v0"][2].get<float>()};
-            std::vector<float> v1 = {shape["v1"][0].get<float>(), shape["v1"][1].get<float>(), shape["v1"][2].get<float>()};
-            std::vector<float> v2 = {shape["v2"][0].get<float>(), shape["v2"][1].get<float>(), shape["v2"][2].get<float>()};
-            float ks_coeffcient = shape["material"]["ks"].get<float>();
-            float kd_coeffcient = shape["material"]["kd"].get<float>();
-            float specular_exponent = shape["material"]["specularexponent"].get<float>();
-            std::vector<float> specular_color = shape["material"]["specularcolor"].get<std::vector<float>>();
-            std::vector<float> diffuse_color = shape["material"]["diffusecolor"].get<std::vector<float>>();
-            bool is_reflective = shape["material"]["isreflective"].get<bool>();
-            float reflectivity = shape["material"]["reflectivity"].get<float>();
-            bool is_refractive = shape["material"]["isrefractive"].get<bool>();
-            float refractive_index = shape["material"]["refractiveindex"].get<float>();
-
-            Material material(ks_coeffcient, kd_coeffcient, specular_exponent, diffuse_color, specular_color, is_reflective, reflectivity, is_refractive, refractive_index);
+            for (const auto &track_config : config["instances"])
+            {
+                std::string name = track_config["name"].get<std::string>();
+                auto instance = instance_ids.find(name);
+                if (instance == instance_ids.end())
+                {
+                    throw std::runtime_error("Animation references unknown instance '" + name + "'");
+                }
+                InstanceTrack track{instance->second, {}};
+                for (const auto &key : track_config["keyframes"])
+                {
+                    TransformKeyframe keyframe = parseTransformKeyframe(key);
+                    // Checked here rather than when the frame is reached.
+                    float transform[12];
+                    float inverse[12];
+                    composeTransform(keyframe.translate, keyframe.rotate, keyframe.scale, transform);
+                    if (!invertTransform(transform, inverse))
+                    {
+                        throw std::runtime_error("Animation keyframe for '" + name + "' is not invertible");
+                    }
+                    track.keyframes.push_back(keyframe);
+                }
+                animation.instances.push_back(std::move(track));
+            }
+        }
 
-            triangles.emplace_back(v0, v1, v2, material);
+        auto by_frame = [](const auto &a, const auto &b) { return a.frame < b.frame; };
+        std::stable_sort(animation.camera.begin(), animation.camera.end(), by_frame);
+        for (auto &track : animation.instances)
+        {
+            if (track.keyframes.empty())
+            {
+                throw std::runtime_error("Animated instance has no keyframes");
+            }
+            std::stable_sort(track.keyframes.begin(), track.keyframes.end(), by_frame);
         }
     }
+
+    auto build_start = std::chrono::steady_clock::now();
+    scene->setCompressedNodes(j.value("compressbvh", false));
+    scene->commit();
+    build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+    *log << "Acceleration structure build: " << build_seconds * 1000.0 << " ms" << std::endl;
 };
 
-std::vector<float> Tools::handleReflection(const Ray &ray, const std::vector<float> &intersectionPoint, const std::vector<float> &normal, int depth, const std::string &rendermode)
+Vec3 Tools::handleReflection(const Ray &ray, const HitRecord &hit, const Vec3 &intersectionPoint, const Vec3 &normal, int depth, float weight, const std::string &rendermode)
 {
-    std::vector<float> reflectionDir = reflect(ray.direction, normal);
+    Vec3 reflectionDir = reflect(ray.direction, normal);
     normalize(reflectionDir);
-    std::vector<float> temp = {intersectionPoint[0] + 0.001f * reflectionDir[0],
-                               intersectionPoint[1] + 0.001f * reflectionDir[1],
-                               intersectionPoint[2] + 0.001f * reflectionDir[2]};
-    Ray reflectionRay(temp, reflectionDir);
-    return traceRay(reflectionRay, depth + 1, rendermode);
+    Ray reflectionRay = localScene().spawnRay(hit, intersectionPoint, normal, reflectionDir);
+    return traceRay(reflectionRay, depth + 1, rendermode, weight);
 };
 
-std::vector<float> Tools::handleRefraction(const Ray &ray, const std::vector<float> &intersectionPoint, std::vector<float> &normal, const Material &material, float cos_theta, int depth, const std::string &rendermode)
+Vec3 Tools::handleRefraction(const Ray &ray, const HitRecord &hit, const Vec3 &intersectionPoint, const Vec3 &normal, const Material &material, float cos_theta, int depth, float weight, const std::string &rendermode)
 {
+    // Refraction wants the normal facing the incoming ray; spawnRay still
+    // takes the outward one.
+    Vec3 facing = normal;
     float eta_ratio = material.refractive_index;
     if (cos_theta < 0.0f)
     {
-        normal[0] = -normal[0];
-        normal[1] = -normal[1];
-        normal[2] = -normal[2];
+        facing = {-normal[0], -normal[1], -normal[2]};
         eta_ratio = 1.0f / eta_ratio;
     }
 
-    std::vector<float> refractedDir = refract(ray.direction, normal, eta_ratio);
-    if (!refractedDir.empty())
+    Vec3 refractedDir;
+    if (refract(ray.direction, facing, eta_ratio, refractedDir))
     {
         normalize(refractedDir);
-        std::vector<float> refractionPoint{
-            intersectionPoint[0] + 0.001f * refractedDir[0],
-            intersectionPoint[1] + 0.001f * refractedDir[1],
-            intersectionPoint[2] + 0.001f * refractedDir[2]};
-        Ray refractionRay(refractionPoint, refractedDir);
-        return traceRay(refractionRay, depth + 1, rendermode);
+        Ray refractionRay = localScene().spawnRay(hit, intersectionPoint, normal, refractedDir);
+        return traceRay(refractionRay, depth + 1, rendermode, weight);
     }
     return {0.0f, 0.0f, 0.0f};
 };
 
-std::vector<float> Tools::combineColors(const std::vector<float>& phongColor, const std::vector<float>& reflectionColor, const std::vector<float>& refractionColor, const Material& material, float effectiveReflectivity, float transparency) {
-    std::vector<float> finalColor(3);
+Vec3 Tools::combineColors(const Vec3& phongColor, const Vec3& reflectionColor, const Vec3& refractionColor, const Material& material) {
+    Vec3 finalColor;
 
     float reflectivity = material.is_reflective ? material.reflectivity : 0.0f;
 
     float refractionFactor = material.is_refractive ? (1.0f - reflectivity) : 0.0f;
 
-    float phongFactor = 1.0f - effectiveReflectivity - transparency;
-    if (phongFactor < 0.0f) {
-        phongFactor = 0.0f;
-    }
-
     for (int i = 0; i < 3; ++i) {
         finalColor[i] = phongColor[i] * (1.0f - reflectivity - refractionFactor)
                         + reflectionColor[i] * reflectivity
@@ -169,128 +389,806 @@ std::vector<float> Tools::combineColors(const std::vector<float>& phongColor, co
     return finalColor;
 }
 
+bool Tools::contributes(float weight) const
+{
+    if (std::fabs(weight) >= min_contribution)
+    {
+        return true;
+    }
+    ++thread_pruned_rays;
+    return false;
+}
+
 
-std::vector<float> Tools::traceRay(const Ray &ray, int depth, const std::string &rendermode)
+// Terms a kernel leaves out enter combineColors as black with zero weight, so
+// every kernel returns what the full model would for its materials. Secondary
+// rays too faint to matter (see setMinContribution) are left black as well.
+template <ShadingKernel kernel>
+Vec3 Tools::shadeHit(const Ray &ray, const ShaderResult &result, int depth, float weight, const std::string &rendermode)
 {
+    typedef KernelTraits<kernel> Traits;
+    const Material &material = *result.intersected_material;
+    const Vec3 &intersectionPoint = result.intersection_point;
+    const Vec3 &normal = result.normal;
 
-    if (depth > nbounces)
+    Vec3 phong_color = {0.0f, 0.0f, 0.0f};
+    Vec3 reflectionColor = {0.0f, 0.0f, 0.0f};
+    Vec3 refractionColor = {0.0f, 0.0f, 0.0f};
+    if constexpr (Traits::phong)
     {
-        return backgroundcolor;
+        Vec3 viewDir = {
+            camera.position[0] - intersectionPoint[0],
+            camera.position[1] - intersectionPoint[1],
+            camera.position[2] - intersectionPoint[2]};
+        normalize(viewDir);
+        phong_color = BlinnPhongShader::calculateColor<Traits::specular>(result.hit, intersectionPoint, normal, viewDir, material, lightsources, localScene());
     }
 
-    std::vector intersection_color = backgroundcolor;
-
-    if (rendermode == "phong")
+    float reflectivity = Traits::reflect ? material.reflectivity : 0.0f;
+    float transparency = Traits::refract ? (1.0f - reflectivity) : 0.0f;
+    if constexpr (Traits::reflect)
     {
-        ShaderResult result = BlinnPhongShader::intersectionTests(ray, spheres, cylinders, triangles, backgroundcolor);
-        intersection_color = result.color;
-        bool intersected = result.intersected;
-        std::vector<float> intersectionPoint = result.intersection_point;
-        Material intersectedMaterial = result.intersected_material;
-        std::vector<float> normal = result.normal;
-        
-        if (intersected)
+        if (contributes(weight * reflectivity))
+        {
+            reflectionColor = handleReflection(ray, result.hit, intersectionPoint, normal, depth, weight * reflectivity, rendermode);
+        }
+    }
+    if constexpr (Traits::refract)
+    {
+        if (contributes(weight * transparency))
         {
-            std::vector<float> viewDir = {
-                position[0] - intersectionPoint[0],
-                position[1] - intersectionPoint[1],
-                position[2] - intersectionPoint[2]};
-            normalize(viewDir);
             float cos_theta = -(ray.direction[0] * normal[0] +
                                 ray.direction[1] * normal[1] +
                                 ray.direction[2] * normal[2]);
+            refractionColor = handleRefraction(ray, result.hit, intersectionPoint, normal, material, cos_theta, depth, weight * transparency, rendermode);
+        }
+    }
 
-            std::vector<float> phong_color = BlinnPhongShader::calculateColor(intersectionPoint, normal, viewDir, intersectedMaterial, lightsources, spheres, cylinders, triangles);
+    return combineColors(phong_color, reflectionColor, refractionColor, material);
+}
 
-            std::vector<float> reflectionColor = {0.0f, 0.0f, 0.0f};
-            std::vector<float> refractionColor = {0.0f, 0.0f, 0.0f};
+Vec3 Tools::traceRay(const Ray &ray, int depth, const std::string &rendermode, float weight, AovSample *aov)
+{
 
-            if (intersectedMaterial.is_reflective)
-            {
-                reflectionColor = handleReflection(ray, intersectionPoint, normal, depth, rendermode);
-            }
-            if (intersectedMaterial.is_refractive)
+    if (depth > nbounces)
+    {
+        return backgroundcolor;
+    }
+    if (depth > 0)
+    {
+        ++thread_secondary_rays;
+    }
+
+    Vec3 intersection_color = backgroundcolor;
+
+    if (rendermode == "phong")
+    {
+        ShaderResult result = BlinnPhongShader::intersectionTests(ray, localScene(), backgroundcolor);
+        intersection_color = result.color;
+        if (aov)
+        {
+            *aov = result.intersected ? AovSample::fromHit(localScene(), result.hit, result.normal, *result.intersected_material) : AovSample();
+        }
+        if (result.intersected)
+        {
+            switch (result.intersected_material->kernel)
             {
-                refractionColor = handleRefraction(ray, intersectionPoint, normal, intersectedMaterial, cos_theta, depth, rendermode);
+            case ShadingKernel::Diffuse:
+                intersection_color = shadeHit<ShadingKernel::Diffuse>(ray, result, depth, weight, rendermode);
+                break;
+            case ShadingKernel::Specular:
+                intersection_color = shadeHit<ShadingKernel::Specular>(ray, result, depth, weight, rendermode);
+                break;
+            case ShadingKernel::Glossy:
+                intersection_color = shadeHit<ShadingKernel::Glossy>(ray, result, depth, weight, rendermode);
+                break;
+            case ShadingKernel::Mirror:
+                intersection_color = shadeHit<ShadingKernel::Mirror>(ray, result, depth, weight, rendermode);
+                break;
+            case ShadingKernel::Glass:
+                intersection_color = shadeHit<ShadingKernel::Glass>(ray, result, depth, weight, rendermode);
+                break;
+            case ShadingKernel::ReflectiveGlass:
+                intersection_color = shadeHit<ShadingKernel::ReflectiveGlass>(ray, result, depth, weight, rendermode);
+                break;
             }
-            float reflectivity = intersectedMaterial.is_reflective ? intersectedMaterial.reflectivity : 0.0f;
-            float transparency = intersectedMaterial.is_refractive ? (1.0f - reflectivity) : 0.0f;
-            float fresnel = pow(1.0f - fabs(cos_theta), 5.0f);
-            float effectiveReflectivity = reflectivity * fresnel;
-
-            intersection_color = combineColors(phong_color, reflectionColor, refractionColor, intersectedMaterial, effectiveReflectivity, transparency);
         }
     }
 
     if (rendermode == "binary")
     {
-        ShaderResult result = BinaryShader::calculateColor(ray, spheres, cylinders, triangles, backgroundcolor);
+        ShaderResult result = BinaryShader::calculateColor(ray, localScene(), backgroundcolor);
         intersection_color = result.color;
     }
 
     return intersection_color;
 }
 
-void Tools::render(PPMWriter &ppmwriter, std::string rendermode)
+void Tools::enableNuma()
 {
+    NumaTopology topology = NumaTopology::detect();
+    ThreadPool &pool = ThreadPool::shared();
 
-    std::vector<float> forward = {lookAt[0] - position[0], lookAt[1] - position[1], lookAt[2] - position[2]};
+    // Deal cores out round-robin across nodes so that a pool smaller than the
+    // machine still spreads over every socket; each worker gets one core.
+    std::vector<std::pair<int, int>> cores;
+    size_t most_cpus = 0;
+    for (const auto &cpus : topology.node_cpus)
+    {
+        most_cpus = std::max(most_cpus, cpus.size());
+    }
+    for (size_t rank = 0; rank < most_cpus; ++rank)
+    {
+        for (int node = 0; node < topology.nodeCount(); ++node)
+        {
+            if (rank < topology.node_cpus[node].size())
+            {
+                cores.push_back({node, topology.node_cpus[node][rank]});
+            }
+        }
+    }
+
+    bool pinned = true;
+    worker_nodes.assign(pool.size(), 0);
+    for (int worker = 0; worker < pool.size(); ++worker)
+    {
+        const auto &core = cores[worker % cores.size()];
+        worker_nodes[worker] = core.first;
+        pinned = pool.pinWorker(worker, {core.second}) && pinned;
+    }
+    // The calling thread renders tiles too; it uses node 0's replica.
+    pinned = pinCurrentThread(topology.node_cpus[0]) && pinned;
+
+    // Each replica is copied by a thread running on its node, so first-touch
+    // places its pages in that node's memory.
+    node_scenes.clear();
+    if (topology.nodeCount() > 1)
+    {
+        node_scenes.resize(topology.nodeCount());
+        std::vector<std::thread> copiers;
+        for (int node = 0; node < topology.nodeCount(); ++node)
+        {
+            copiers.emplace_back([this, &topology, node] {
+                pinCurrentThread(topology.node_cpus[node]);
+                node_scenes[node] = std::make_shared<Scene>(*scene);
+            });
+        }
+        for (auto &copier : copiers)
+        {
+            copier.join();
+        }
+    }
+
+    *log << "NUMA: " << topology.nodeCount() << " node(s), " << pool.size() << " workers"
+         << (pinned ? " pinned" : " not pinned (unsupported)") << ", "
+         << (node_scenes.empty() ? "shared scene" : std::to_string(node_scenes.size()) + " scene replicas") << std::endl;
+}
+
+const Scene &Tools::localScene() const
+{
+    if (node_scenes.empty())
+    {
+        return *scene;
+    }
+    int worker = ThreadPool::currentWorker();
+    int node = worker >= 0 && worker < static_cast<int>(worker_nodes.size()) ? worker_nodes[worker] : 0;
+    return *node_scenes[node];
+}
+
+void Tools::setAovOutput(AovBuffers *buffers)
+{
+    aovs = buffers;
+    if (!aovs)
+    {
+        return;
+    }
+    // Ids are written as floats, which hold integers exactly only up to 2^24.
+    auto primitives = [](const GeometryGroup &group) { return group.spheres.size() + group.cylinders.size() + group.triangles.size(); };
+    size_t largest = std::max({scene->instances.size(), static_cast<size_t>(material_count), primitives(scene->shapes)});
+    for (const auto &group : scene->groups)
+    {
+        largest = std::max(largest, primitives(group));
+    }
+    if (largest >= (size_t(1) << 24))
+    {
+        std::cerr << "Warning: the scene has 2^24 or more primitives, instances or materials; "
+                  << "ids in the id buffer will be rounded." << std::endl;
+    }
+}
+
+void Tools::setCheckpoint(const std::string &path, double interval_seconds)
+{
+    checkpoint_path = path;
+    checkpoint_interval = interval_seconds;
+}
+
+void Tools::clearCheckpoint()
+{
+    if (!checkpoint_path.empty())
+    {
+        std::remove(checkpoint_path.c_str());
+    }
+}
+
+// Everything that decides the pixels of a render; a checkpoint only resumes
+// a render whose description matches exactly.
+std::string Tools::renderSettings(const std::string &rendermode, const std::vector<ImageRegion> &areas) const
+{
+    std::ostringstream settings;
+    settings.precision(9);
+    settings << "scene=" << scene_file << " contents=" << scene_hash << " mode=" << rendermode << " bounces=" << nbounces
+             << " size=" << camera.width << "x" << camera.height << " fov=" << camera.fov << " exposure=" << camera.exposure
+             << " tile=" << tile_size << " order=" << tileOrderName(tile_order) << " samples=" << camera.samples << " seed=" << camera.seed
+             << " mincontribution=" << min_contribution;
+    for (const auto *vector : {&camera.position, &camera.lookAt, &camera.upVector})
+    {
+        settings << " " << (*vector)[0] << "," << (*vector)[1] << "," << (*vector)[2];
+    }
+    for (const auto &area : areas)
+    {
+        settings << " region=" << area.x0 << "," << area.y0 << "," << area.x1 << "," << area.y1;
+    }
+    return settings.str();
+}
+
+void Tools::cameraBasis(Vec3 &position, Vec3 &forward, Vec3 &right, Vec3 &up) const
+{
+    position = {camera.position[0], camera.position[1], camera.position[2]};
+    forward = {camera.lookAt[0] - position[0], camera.lookAt[1] - position[1], camera.lookAt[2] - position[2]};
     normalize(forward);
-    std::vector<float> right = {upVector[1] * forward[2] - upVector[2] * forward[1],
-                                upVector[2] * forward[0] - upVector[0] * forward[2],
-                                upVector[0] * forward[1] - upVector[1] * forward[0]};
+    right = {camera.upVector[1] * forward[2] - camera.upVector[2] * forward[1],
+             camera.upVector[2] * forward[0] - camera.upVector[0] * forward[2],
+             camera.upVector[0] * forward[1] - camera.upVector[1] * forward[0]};
     normalize(right);
-    std::vector<float> up = {forward[1] * right[2] - forward[2] * right[1],
-                             forward[2] * right[0] - forward[0] * right[2],
-                             forward[0] * right[1] - forward[1] * right[0]};
+    up = {forward[1] * right[2] - forward[2] * right[1],
+          forward[2] * right[0] - forward[0] * right[2],
+          forward[0] * right[1] - forward[1] * right[0]};
 
     normalize(up);
-    float aspectRatio = static_cast<float>(width) / height;
-    float scale = tan(fov * 0.5 * pi / 180.0f);
+}
 
-    for (int y = 0; y < height; ++y)
+void Tools::benchmarkBvh(int passes)
+{
+    // One ray through every pixel centre, plus a shadow ray towards the first
+    // light from every hit; traced single-threaded so the layouts compare
+    // on cache behaviour rather than scheduling.
+    Vec3 position, forward, right, up;
+    cameraBasis(position, forward, right, up);
+    float aspectRatio = static_cast<float>(camera.width) / camera.height;
+    float scale = tan(camera.fov * 0.5 * pi / 180.0f);
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(camera.width) * camera.height);
+    for (int y = 0; y < camera.height; ++y)
     {
-        for (int x = 0; x < width; ++x)
+        for (int x = 0; x < camera.width; ++x)
         {
-            float u = (2 * (x + 0.5f) / width - 1) * aspectRatio * scale;
-            float v = (1 - 2 * (y + 0.5f) / height) * scale;
-
-            std::vector<float> direction = {right[0] * u + up[0] * v + forward[0],
-                                            right[1] * u + up[1] * v + forward[1],
-                                            right[2] * u + up[2] * v + forward[2]};
+            float u = (2 * (x + 0.5f) / camera.width - 1) * aspectRatio * scale;
+            float v = (1 - 2 * (y + 0.5f) / camera.height) * scale;
+            Vec3 direction = {right[0] * u + up[0] * v + forward[0],
+                              right[1] * u + up[1] * v + forward[1],
+                              right[2] * u + up[2] * v + forward[2]};
             normalize(direction);
-            Ray ray(position, direction);
+            rays.emplace_back(position, direction);
+        }
+    }
 
-            std::vector<float> intersection_color = traceRay(ray, 0, rendermode);
+    bool was_compressed = scene->shapes.isCompressed();
+    std::vector<HitRecord> reference_hits;
+    std::vector<Ray> shadow_rays;
+    std::vector<char> reference_blocked;
+    size_t full_bytes = 0;
+    for (bool compressed : {false, true})
+    {
+        scene->setCompressedNodes(compressed);
+        std::vector<HitRecord> hits(rays.size());
+        double closest_seconds = std::numeric_limits<double>::max();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < rays.size(); ++i)
+            {
+                hits[i] = HitRecord();
+                scene->intersect(rays[i], hits[i]);
+            }
+            closest_seconds = std::min(closest_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
 
-            max_value = std::max({max_value, intersection_color[0], intersection_color[1], intersection_color[2]});
+        if (!compressed)
+        {
+            reference_hits = hits;
+            for (size_t i = 0; i < rays.size() && !lightsources.empty(); ++i)
+            {
+                if (hits[i].t < std::numeric_limits<float>::max())
+                {
+                    Vec3 point, normal;
+                    const Material *material;
+                    scene->surfaceAt(rays[i], hits[i], point, normal, material);
+                    shadow_rays.push_back(Shadow::shadowRay(*scene, hits[i], point, normal, lightsources[0]));
+                }
+            }
+        }
+        std::vector<char> blocked(shadow_rays.size());
+        double any_seconds = std::numeric_limits<double>::max();
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < shadow_rays.size(); ++i)
+            {
+                blocked[i] = scene->occluded(shadow_rays[i]);
+            }
+            any_seconds = std::min(any_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
 
-            ppmwriter.getPixelData(x, y, {static_cast<unsigned char>(intersection_color[0] * 255), static_cast<unsigned char>(intersection_color[1] * 255), static_cast<unsigned char>(intersection_color[2] * 255)});
+        size_t bytes = scene->nodeBytes();
+        *log << (compressed ? "compressed" : "binary    ") << ": " << bytes / 1024.0 << " KB of nodes, closest hit "
+             << rays.size() / closest_seconds * 1e-6 << " Mrays/s, any hit " << shadow_rays.size() / any_seconds * 1e-6 << " Mrays/s";
+        if (!compressed)
+        {
+            full_bytes = bytes;
+            reference_blocked = blocked;
+            *log << std::endl;
+            continue;
+        }
+        // Closest hits are compared by distance: at a shared edge either
+        // triangle is a valid answer.
+        size_t mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            mismatches += hits[i].t != reference_hits[i].t;
         }
+        for (size_t i = 0; i < shadow_rays.size(); ++i)
+        {
+            mismatches += blocked[i] != reference_blocked[i];
+        }
+        *log << ", " << static_cast<double>(full_bytes) / std::max<size_t>(bytes, 1) << "x smaller, " << mismatches
+             << " queries disagree" << std::endl;
+    }
 
-        // for (int y = 0; y < height; ++y)
-        // {
-        //     for (int x = 0; x < width; ++x)
-        //     {
-        //         float u = (2 * (x + 0.5f) / width - 1) * aspectRatio * scale;
-        //         float v = (1 - 2 * (y + 0.5f) / height) * scale;
+    // Coverage of the camera rays, one ray at a time and as packets of 8x8
+    // pixel blocks, on the binary layout.
+    scene->setCompressedNodes(false);
+    std::vector<Ray> block_rays;
+    std::vector<int> block_sizes;
+    block_rays.reserve(rays.size());
+    for (int block_y = 0; block_y < camera.height; block_y += 8)
+    {
+        for (int block_x = 0; block_x < camera.width; block_x += 8)
+        {
+            size_t first = block_rays.size();
+            for (int y = block_y; y < std::min(block_y + 8, camera.height); ++y)
+            {
+                for (int x = block_x; x < std::min(block_x + 8, camera.width); ++x)
+                {
+                    block_rays.push_back(rays[static_cast<size_t>(y) * camera.width + x]);
+                }
+            }
+            block_sizes.push_back(static_cast<int>(block_rays.size() - first));
+        }
+    }
+    std::vector<char> single(block_rays.size());
+    std::vector<char> packed(block_rays.size());
+    double single_seconds = std::numeric_limits<double>::max();
+    double packet_seconds = std::numeric_limits<double>::max();
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < block_rays.size(); ++i)
+        {
+            single[i] = scene->occluded(block_rays[i]);
+        }
+        single_seconds = std::min(single_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 
-        //         std::vector<float> direction = {right[0] * u + up[0] * v + forward[0],
-        //                                         right[1] * u + up[1] * v + forward[1],
-        //                                         right[2] * u + up[2] * v + forward[2]};
-        //         normalize(direction);
-        //         Ray ray(position, direction);
+        start = std::chrono::steady_clock::now();
+        size_t first = 0;
+        for (int size : block_sizes)
+        {
+            uint64_t covered = scene->occluded(&block_rays[first], size);
+            for (int i = 0; i < size; ++i)
+            {
+                packed[first + i] = covered >> i & 1;
+            }
+            first += size;
+        }
+        packet_seconds = std::min(packet_seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    size_t coverage_mismatches = 0;
+    for (size_t i = 0; i < single.size(); ++i)
+    {
+        coverage_mismatches += single[i] != packed[i];
+    }
+    *log << "coverage  : single rays " << single.size() / single_seconds * 1e-6 << " Mrays/s, 8x8 packets "
+         << single.size() / packet_seconds * 1e-6 << " Mrays/s, " << coverage_mismatches << " rays disagree" << std::endl;
+    scene->setCompressedNodes(was_compressed);
+}
+
+void Tools::benchmarkPruning()
+{
+    // Both renders run quietly and without checkpoints; only the comparison
+    // is logged.
+    std::ostream *saved_log = log;
+    std::string saved_checkpoint = checkpoint_path;
+    float threshold = min_contribution;
+    std::ostringstream quiet;
+    log = &quiet;
+    checkpoint_path.clear();
+
+    std::vector<unsigned char> backgrounddata = {64, 64, 64};
+    PPMWriter images[2] = {PPMWriter(camera.width, camera.height, backgrounddata), PPMWriter(camera.width, camera.height, backgrounddata)};
+    double seconds[2];
+    uint64_t traced[2];
+    for (int pruned = 0; pruned < 2; ++pruned)
+    {
+        min_contribution = pruned ? threshold : 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        render(images[pruned], "phong");
+        seconds[pruned] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        traced[pruned] = secondary_rays;
+    }
+    log = saved_log;
+    checkpoint_path = saved_checkpoint;
+    min_contribution = threshold;
+
+    const std::vector<unsigned char> &reference = images[0].getPixels();
+    const std::vector<unsigned char> &pixels = images[1].getPixels();
+    size_t differing = 0;
+    int max_difference = 0;
+    double squared_error = 0.0;
+    for (size_t i = 0; i < pixels.size(); i += 3)
+    {
+        bool differs = false;
+        for (size_t c = i; c < i + 3; ++c)
+        {
+            int difference = std::abs(pixels[c] - reference[c]);
+            differs = differs || difference > 0;
+            max_difference = std::max(max_difference, difference);
+            squared_error += static_cast<double>(difference) * difference;
+        }
+        differing += differs;
+    }
+    double rms = std::sqrt(squared_error / std::max<size_t>(pixels.size(), 1));
+
+    *log << "unpruned: " << traced[0] << " secondary rays, " << seconds[0] * 1000.0 << " ms" << std::endl;
+    *log << "pruned:   " << traced[1] << " secondary rays, " << seconds[1] * 1000.0 << " ms at contribution " << threshold
+         << "; " << traced[0] - std::min(traced[0], traced[1]) << " rays saved, " << pruned_rays << " cut off" << std::endl;
+    *log << "image error: " << differing << " of " << pixels.size() / 3 << " pixels differ, max " << max_difference
+         << "/255, rms " << rms << "/255" << std::endl;
+}
+
+void Tools::render(PPMWriter &ppmwriter, std::string rendermode, const std::vector<ImageRegion> &regions)
+{
 
-        //         std::vector<float> intersection_color = traceRay(ray, 0, rendermode);
+    Vec3 position, forward, right, up;
+    cameraBasis(position, forward, right, up);
+    float aspectRatio = static_cast<float>(camera.width) / camera.height;
+    float scale = tan(camera.fov * 0.5 * pi / 180.0f);
+
+    if (aovs && (aovs->getWidth() != camera.width || aovs->getHeight() != camera.height))
+    {
+        throw std::runtime_error("Auxiliary output buffers do not match the camera resolution");
+    }
+
+    auto render_start = std::chrono::steady_clock::now();
+
+    // Work is split into tiles of the requested regions. Each tile renders
+    // into its own buffer and is committed to the framebuffer under a lock, so
+    // a checkpoint always sees whole tiles.
+    std::vector<ImageRegion> areas = regions;
+    if (areas.empty())
+    {
+        areas.push_back({0, 0, camera.width, camera.height});
+    }
+    std::vector<ImageRegion> tiles;
+    for (const auto &area : areas)
+    {
+        ImageRegion clipped = clipRegion(area, camera.width, camera.height);
+        for (int y = clipped.y0; y < clipped.y1; y += tile_size)
+        {
+            for (int x = clipped.x0; x < clipped.x1; x += tile_size)
+            {
+                tiles.push_back({x, y, std::min(x + tile_size, clipped.x1), std::min(y + tile_size, clipped.y1)});
+            }
+        }
+    }
+
+    orderTiles(tiles, tile_size, tile_order);
+
+    std::vector<char> done(tiles.size(), 0);
+    std::string settings;
+    if (!checkpoint_path.empty())
+    {
+        settings = renderSettings(rendermode, areas);
+        std::vector<unsigned char> pixels = ppmwriter.getPixels();
+        if (RenderCheckpoint::load(checkpoint_path, settings, done, pixels, max_value))
+        {
+            ppmwriter.setPixels(pixels);
+            *log << "Resuming from " << checkpoint_path << ": " << std::count(done.begin(), done.end(), 1) << " of " << tiles.size() << " tiles done" << std::endl;
+        }
+    }
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (!done[i])
+        {
+            pending.push_back(i);
+        }
+    }
+
+    // Tile buffers come from the rendering thread's arena and are released
+    // when the tile is committed. Heap allocations made while a tile's pixels
+    // are traced are counted, arena growth included, and the blocks the
+    // arenas took are reported as well; in steady state there should be none.
+    std::mutex commit_mutex;
+    std::mutex save_mutex;
+    std::atomic<uint64_t> hot_allocations{0};
+    std::atomic<uint64_t> tile_secondary_rays{0};
+    std::atomic<uint64_t> tile_pruned_rays{0};
+    uint64_t arena_blocks_before = Arena::blockAllocations();
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    TileScheduler scheduler(ThreadPool::shared());
+    WavefrontStats wavefront_stats;
+
+    // Sample positions come from a stream keyed by pixel and sample index, so
+    // they do not depend on tile scheduling.
+    auto cameraRay = [&](int x, int y, int sample) {
+        float jitter_x = 0.5f;
+        float jitter_y = 0.5f;
+        if (camera.samples > 1)
+        {
+            RandomStream random(static_cast<uint32_t>(y * camera.width + x), sample, 0, camera.seed);
+            jitter_x = random.nextFloat();
+            jitter_y = random.nextFloat();
+        }
+        float u = (2 * (x + jitter_x) / camera.width - 1) * aspectRatio * scale;
+        float v = (1 - 2 * (y + jitter_y) / camera.height) * scale;
+
+        Vec3 direction = {right[0] * u + up[0] * v + forward[0],
+                          right[1] * u + up[1] * v + forward[1],
+                          right[2] * u + up[2] * v + forward[2]};
+        normalize(direction);
+        return Ray(position, direction);
+    };
+
+    std::vector<WorkerStats> worker_stats = scheduler.run(pending.size(), [&](size_t i) {
+        const ImageRegion &tile = tiles[pending[i]];
+        Arena &arena = Arena::local();
+        ArenaScope scope(arena);
+        unsigned char *pixels = arena.allocateArray<unsigned char>(static_cast<size_t>(tile.width()) * tile.height() * 3);
+        uint64_t heap_before = threadHeapAllocations();
+        uint64_t secondary_before = thread_secondary_rays;
+        uint64_t pruned_before = thread_pruned_rays;
+
+        // First hits of the camera rays, indexed like their samples. The
+        // recursive path goes pixel by pixel and only keeps one pixel's.
+        AovSample *aov_samples = nullptr;
+        if (aovs)
+        {
+            bool batched = wavefront || rendermode == "binary";
+            size_t sample_count = (batched ? static_cast<size_t>(tile.width()) * tile.height() : 1) * camera.samples;
+            aov_samples = arena.allocateArray<AovSample>(sample_count);
+            std::fill(aov_samples, aov_samples + sample_count, AovSample());
+        }
+
+        // The wavefront pipeline traces every sample of the tile as one batch
+        // up front; the pixel loop then only averages the results.
+        Vec3 *sample_colors = nullptr;
+        WavefrontStats tile_stats;
+        if (wavefront)
+        {
+            auto generate_start = std::chrono::steady_clock::now();
+            RayQueue primary;
+            primary.allocate(arena, static_cast<size_t>(tile.width()) * tile.height() * camera.samples);
+            for (int y = tile.y0; y < tile.y1; ++y)
+            {
+                for (int x = tile.x0; x < tile.x1; ++x)
+                {
+                    for (int sample = 0; sample < camera.samples; ++sample)
+                    {
+                        Ray ray = cameraRay(x, y, sample);
+                        primary.push(ray, -1, static_cast<int>(primary.count));
+                    }
+                }
+            }
+            tile_stats.generate_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - generate_start).count();
+            sample_colors = arena.allocateArray<Vec3>(primary.count);
+            Wavefront tracer(localScene(), lightsources, backgroundcolor, position, nbounces, rendermode != "binary", sort_secondary, min_contribution);
+            tracer.trace(arena, primary, sample_colors, tile_stats, aov_samples);
+            tile_secondary_rays += tile_stats.secondary_rays;
+            tile_pruned_rays += tile_stats.pruned_rays;
+        }
+        else if (rendermode == "binary")
+        {
+            // Binary mode only needs coverage, so the camera rays of each
+            // 8x8 pixel block go through the scene as packets.
+            const int block = 8;
+            sample_colors = arena.allocateArray<Vec3>(static_cast<size_t>(tile.width()) * tile.height() * camera.samples);
+            Ray *packet = arena.allocateArray<Ray>(RayPacket::kMaxRays);
+            size_t *targets = arena.allocateArray<size_t>(RayPacket::kMaxRays);
+            Vec3 *packet_colors = arena.allocateArray<Vec3>(RayPacket::kMaxRays);
+            int count = 0;
+            auto flush = [&]() {
+                BinaryShader::calculateColors(packet, count, localScene(), backgroundcolor, packet_colors);
+                for (int r = 0; r < count; ++r)
+                {
+                    sample_colors[targets[r]] = packet_colors[r];
+                }
+                count = 0;
+            };
+            for (int block_y = tile.y0; block_y < tile.y1; block_y += block)
+            {
+                for (int block_x = tile.x0; block_x < tile.x1; block_x += block)
+                {
+                    for (int y = block_y; y < std::min(block_y + block, tile.y1); ++y)
+                    {
+                        for (int x = block_x; x < std::min(block_x + block, tile.x1); ++x)
+                        {
+                            for (int sample = 0; sample < camera.samples; ++sample)
+                            {
+                                packet[count] = cameraRay(x, y, sample);
+                                targets[count++] = (static_cast<size_t>(y - tile.y0) * tile.width() + (x - tile.x0)) * camera.samples + sample;
+                                if (count == RayPacket::kMaxRays)
+                                {
+                                    flush();
+                                }
+                            }
+                        }
+                    }
+                    if (count > 0)
+                    {
+                        flush();
+                    }
+                }
+            }
+        }
+
+        float tile_max = 0.0f;
+        for (int y = tile.y0; y < tile.y1; ++y)
+        {
+            for (int x = tile.x0; x < tile.x1; ++x)
+            {
+                size_t first_sample = (static_cast<size_t>(y - tile.y0) * tile.width() + (x - tile.x0)) * camera.samples;
+                AovSample *pixel_aovs = aov_samples && sample_colors ? aov_samples + first_sample : aov_samples;
+                Vec3 intersection_color = {0.0f, 0.0f, 0.0f};
+                for (int sample = 0; sample < camera.samples; ++sample)
+                {
+                    Vec3 sample_color = sample_colors ? sample_colors[first_sample + sample]
+                                                      : traceRay(cameraRay(x, y, sample), 0, rendermode, 1.0f, pixel_aovs ? &pixel_aovs[sample] : nullptr);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        intersection_color[c] += sample_color[c];
+                    }
+                }
+                for (int c = 0; c < 3; ++c)
+                {
+                    intersection_color[c] /= camera.samples;
+                }
+                // Tiles never share pixels, so this needs no lock.
+                if (aovs)
+                {
+                    aovs->setPixel(x, y, AovBuffers::resolve(pixel_aovs, camera.samples));
+                }
+
+                tile_max = std::max({tile_max, intersection_color[0], intersection_color[1], intersection_color[2]});
+
+                size_t index = (static_cast<size_t>(y - tile.y0) * tile.width() + (x - tile.x0)) * 3;
+                pixels[index] = static_cast<unsigned char>(intersection_color[0] * 255);
+                pixels[index + 1] = static_cast<unsigned char>(intersection_color[1] * 255);
+                pixels[index + 2] = static_cast<unsigned char>(intersection_color[2] * 255);
+            }
+        }
+        hot_allocations += threadHeapAllocations() - heap_before;
+        tile_secondary_rays += thread_secondary_rays - secondary_before;
+        tile_pruned_rays += thread_pruned_rays - pruned_before;
+
+        std::unique_lock<std::mutex> lock(commit_mutex);
+        wavefront_stats += tile_stats;
+        ppmwriter.setRegion(tile, pixels);
+        max_value = std::max(max_value, tile_max);
+        done[pending[i]] = 1;
+        auto now = std::chrono::steady_clock::now();
+        if (!checkpoint_path.empty() && std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval)
+        {
+            // Only the snapshot is taken under the lock, so other workers keep
+            // committing tiles while it is written. A save still in progress
+            // means this one is skipped.
+            std::unique_lock<std::mutex> saving(save_mutex, std::try_to_lock);
+            if (saving.owns_lock())
+            {
+                std::vector<char> saved_done = done;
+                std::vector<unsigned char> saved_pixels = ppmwriter.getPixels();
+                float saved_max = max_value;
+                last_checkpoint = now;
+                lock.unlock();
+                RenderCheckpoint::save(checkpoint_path, settings, saved_done, saved_pixels, saved_max);
+            }
+        }
+    });
+    if (!checkpoint_path.empty())
+    {
+        RenderCheckpoint::save(checkpoint_path, settings, done, ppmwriter.getPixels(), max_value);
+    }
+
+    double render_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
+    *log << "Render: " << render_seconds * 1000.0 << " ms, " << pending.size() << " tiles of " << tile_size
+         << " px in " << tileOrderName(tile_order) << " order" << std::endl;
+    for (size_t worker = 0; worker < worker_stats.size(); ++worker)
+    {
+        *log << "  thread " << worker << ": busy " << worker_stats[worker].busy_seconds * 1000.0 << " ms, idle "
+             << worker_stats[worker].idle_seconds * 1000.0 << " ms, " << worker_stats[worker].tiles << " tiles, "
+             << worker_stats[worker].steals << " steals" << std::endl;
+    }
+    *log << "Hot path: " << hot_allocations.load() << " heap allocations, " << Arena::blockAllocations() - arena_blocks_before
+         << " arena blocks" << std::endl;
+    if (wavefront)
+    {
+        *log << "Wavefront (thread time): generate " << wavefront_stats.generate_seconds * 1000.0 << " ms, intersect "
+             << wavefront_stats.intersect_seconds * 1000.0 << " ms, shade " << wavefront_stats.shade_seconds * 1000.0
+             << " ms, shadow " << wavefront_stats.shadow_seconds * 1000.0 << " ms, resolve "
+             << wavefront_stats.resolve_seconds * 1000.0 << " ms; " << wavefront_stats.rays << " rays, "
+             << wavefront_stats.shadow_rays << " shadow rays" << std::endl;
+    }
+    secondary_rays = tile_secondary_rays.load();
+    pruned_rays = tile_pruned_rays.load();
+    if (min_contribution > 0.0f)
+    {
+        *log << "Pruning: " << secondary_rays << " secondary rays traced, " << pruned_rays << " below contribution "
+             << min_contribution << " skipped" << std::endl;
+    }
+    if (wavefront_stats.secondary_rays > 0)
+    {
+        double pairs = static_cast<double>(wavefront_stats.secondary_rays);
+        *log << "Secondary rays: " << wavefront_stats.secondary_rays << ", " << wavefront_stats.sorted_rays << " sorted in "
+             << wavefront_stats.sort_seconds * 1000.0 << " ms; octant changes " << 100.0 * wavefront_stats.octant_changes_before / pairs << "% -> "
+             << 100.0 * wavefront_stats.octant_changes_after / pairs << "%, mean origin step "
+             << wavefront_stats.origin_steps_before / pairs << " -> " << wavefront_stats.origin_steps_after / pairs << std::endl;
+    }
+}
+
+void Tools::renderAnimation(const std::string &output_pattern, std::string rendermode)
+{
+    std::string pattern = output_pattern.empty() ? animation.output : output_pattern;
+    ThreadPool &pool = ThreadPool::shared();
+
+    // Two frame buffers: while one is being encoded to disk, the next frame
+    // renders into the other.
+    std::vector<unsigned char> backgrounddata = {64, 64, 64};
+    PPMWriter buffers[2] = {PPMWriter(camera.width, camera.height, backgrounddata), PPMWriter(camera.width, camera.height, backgrounddata)};
+    TaskGroup first_encode(pool);
+    TaskGroup second_encode(pool);
+    TaskGroup *encodes[2] = {&first_encode, &second_encode};
+
+    for (int frame = animation.first_frame; frame <= animation.last_frame; ++frame)
+    {
+        int slot = (frame - animation.first_frame) % 2;
+        encodes[slot]->wait();
+
+        animation.cameraAt(static_cast<float>(frame), camera.position, camera.lookAt, camera.fov);
+        for (const auto &track : animation.instances)
+        {
+            float transform[12];
+            Animation::transformAt(track, static_cast<float>(frame), transform);
+            scene->instances[track.instance].setTransform(transform);
+        }
+        auto refit_start = std::chrono::steady_clock::now();
+        int rebuilt = scene->refit(animation.rebuild_threshold);
+        for (auto &replica : node_scenes)
+        {
+            replica->instances = scene->instances;
+            replica->refit(animation.rebuild_threshold);
+        }
+        double refit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - refit_start).count();
+        *log << "Frame " << frame << ": refit " << refit_seconds * 1000.0 << " ms";
+        if (rebuilt > 0)
+        {
+            *log << " (" << rebuilt << " subtrees rebuilt)";
+        }
+        *log << std::endl;
 
-        //         std::vector<float> tone_mapped_color = linearToneMapping(intersection_color, max_value);
+        render(buffers[slot], rendermode);
 
-        //         ppmwriter.getPixelData(x,y, {
-        //             static_cast<unsigned char>(tone_mapped_color[0] * 255),
-        //             static_cast<unsigned char>(tone_mapped_color[1] * 255),
-        //             static_cast<unsigned char>(tone_mapped_color[2] * 255)
-        //         });
-        //     }
-        // }
+        std::string filename = Animation::frameFilename(pattern, frame);
+        PPMWriter *buffer = &buffers[slot];
+        encodes[slot]->run([buffer, filename] { buffer->writePPM(filename); });
     }
+    first_encode.wait();
+    second_encode.wait();
 }
\ No newline at end of file
@@ -1,46 +1,124 @@
 #ifndef TOOLS_H
 #define TOOLS_H
 
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
-#include "sphere.h"
-#include "cylinder.h"
-#include "triangle.h"
+#include "camera.h"
+#include "scene.h"
 #include "ppmWriter.h"
 #include "light.h"
+#include "animation.h"
+#include "image_region.h"
+#include "tile_scheduler.h"
+#include "shader_result.h"
+#include "aov.h"
 
 class Tools
 
 {
 public:
     void readConfig(const std::string &filename);
-    void render(PPMWriter& ppmwriter, std::string rendermode);
-    std::vector<float> traceRay(const Ray& ray, int depth, const std::string& rendermode);
-    std::vector<float> handleReflection(const Ray &ray, const std::vector<float> &intersectionPoint, const std::vector<float> &normal, int depth, const std::string &rendermode);
-    std::vector<float> handleRefraction(const Ray &ray, const std::vector<float> &intersectionPoint, std::vector<float> &normal, const Material &material, float cos_theta, int depth, const std::string &rendermode);
-    std::vector<float> combineColors(const std::vector<float>& phongColor, const std::vector<float>& reflectionColor, const std::vector<float>& refractionColor, const Material& material, const float effectiveReflectivity, float transparency);
+    // Renders the given pixel regions, or the whole image when regions is empty.
+    void render(PPMWriter& ppmwriter, std::string rendermode, const std::vector<ImageRegion>& regions = {});
+    bool isAnimated() const { return !animation.empty(); }
+    const Camera &getCamera() const { return camera; }
+    void setCamera(const Camera &new_camera) { camera = new_camera; }
+    // Timing output goes here; defaults to std::cout.
+    void setLog(std::ostream &stream) { log = &stream; }
+    // Makes render() save finished tiles to path every interval seconds and
+    // resume from it when it matches the current settings.
+    void setCheckpoint(const std::string &path, double interval_seconds);
+    // Pins pool workers to cores and, on multi-socket machines, gives every
+    // NUMA node its own copy of the scene and BVHs so threads only read local
+    // memory. Call after readConfig; costs one scene copy per node.
+    void enableNuma();
+    void clearCheckpoint();
+    // Work is scheduled in square tiles visited along a space-filling curve.
+    void setTileSize(int size) { tile_size = size; }
+    int getTileSize() const { return tile_size; }
+    void setTileOrder(TileOrder order) { tile_order = order; }
+    // Traces tiles breadth-first in ray batches (see wavefront.h) instead of
+    // recursing per ray. Images are identical either way.
+    void setWavefront(bool enabled) { wavefront = enabled; }
+    // Times closest-hit and any-hit queries for one ray per pixel against the
+    // binary and the compressed BVH layouts and logs node memory for each,
+    // then times camera-ray coverage one ray at a time and in packets.
+    void benchmarkBvh(int passes = 3);
+    // Renders every frame of the scene's animation, reusing the scene and its
+    // BVHs; frame N is written out while frame N+1 renders.
+    void renderAnimation(const std::string &output_pattern, std::string rendermode);
+    // Reflection and refraction rays whose color would reach the pixel scaled
+    // by less than threshold are not traced and count as black. 0 traces all.
+    void setMinContribution(float threshold) { min_contribution = threshold; }
+    // Renders the frame in phong mode without pruning and with the current
+    // threshold and logs the rays saved, the time taken and how far the
+    // images differ.
+    void benchmarkPruning();
+    // Makes render() also fill buffers (camera-sized) with the first hit of
+    // each pixel's camera rays; nullptr turns it off. Binary renders find no
+    // closest hits and leave them empty, as do tiles resumed from a checkpoint.
+    // Warns when the scene has ids too large to store exactly.
+    void setAovOutput(AovBuffers *buffers);
+    // weight is the factor the ray's color is scaled by on its way to the
+    // pixel. A primary phong-mode ray records its first hit, or the miss, in
+    // aov if given.
+    Vec3 traceRay(const Ray& ray, int depth, const std::string& rendermode, float weight = 1.0f, AovSample *aov = nullptr);
+    Vec3 handleReflection(const Ray &ray, const HitRecord &hit, const Vec3 &intersectionPoint, const Vec3 &normal, int depth, float weight, const std::string &rendermode);
+    Vec3 handleRefraction(const Ray &ray, const HitRecord &hit, const Vec3 &intersectionPoint, const Vec3 &normal, const Material &material, float cos_theta, int depth, float weight, const std::string &rendermode);
+    Vec3 combineColors(const Vec3& phongColor, const Vec3& reflectionColor, const Vec3& refractionColor, const Material& material);
 
 private:
+    void cameraBasis(Vec3 &position, Vec3 &forward, Vec3 &right, Vec3 &up) const;
+    std::string renderSettings(const std::string &rendermode, const std::vector<ImageRegion> &areas) const;
+    const Scene &localScene() const;
+    // Phong-mode color of a hit, evaluating only the terms of the given kernel.
+    template <ShadingKernel kernel>
+    Vec3 shadeHit(const Ray &ray, const ShaderResult &result, int depth, float weight, const std::string &rendermode);
+    // Whether a secondary ray of this weight is traced; counts those that are not.
+    bool contributes(float weight) const;
+
+    std::string scene_file;
+    // Hash of the scene description and the meshes it loads.
+    uint64_t scene_hash = 0;
 
     int nbounces;
     std::string rendermode;
 
-    std::string camera_type;
-    int width;
-    int height;
-    std::vector<float>  position;
-    std::vector<float>  lookAt;
-    std::vector<float>  upVector;
-    float fov;
-    float exposure;
-
-    std::vector<float>  backgroundcolor;
-    std::vector<Sphere> spheres;
-    std::vector<Cylinder> cylinders;
-    std::vector<Triangle> triangles;
+    Camera camera;
+
+    Vec3 backgroundcolor;
+    // Shared so copies of a loaded Tools (e.g. server jobs with their own
+    // camera) reuse one scene and its BVHs; copies must not animate it.
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+    // Per-node replicas of scene, indexed by NUMA node, and each pool
+    // worker's node; empty unless enableNuma found several nodes.
+    std::vector<std::shared_ptr<Scene>> node_scenes;
+    std::vector<int> worker_nodes;
     std::vector<Light> lightsources;
+    // Materials parsed by readConfig, which numbers them from 0.
+    int material_count = 0;
+    Animation animation;
 
     float max_value = 0.0f;
+    double build_seconds = 0.0;
+    std::ostream *log = &std::cout;
+
+    int tile_size = 64;
+    TileOrder tile_order = TileOrder::Hilbert;
+    bool wavefront = false;
+    // Whether the wavefront pipeline sorts reflection and refraction rays
+    // for coherence before tracing them.
+    bool sort_secondary = true;
+    float min_contribution = 0.0f;
+    // Secondary rays traced and pruned by the last render.
+    uint64_t secondary_rays = 0;
+    uint64_t pruned_rays = 0;
+    AovBuffers *aovs = nullptr;
+    std::string checkpoint_path;
+    double checkpoint_interval = 60.0;
 
 
 };
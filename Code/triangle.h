@@ -4,12 +4,14 @@
 #include "ray.h"
 #include <vector>
 #include "material.h"
+#include "aabb.h"
 
 class Triangle {
     public:
 
         Triangle(const std::vector<float>& v0, const std::vector<float>& v1, const std::vector<float>& v2, Material material);
         bool intersectTriangle(const Ray& ray, float& t) const;
+        Aabb bounds() const;
         std::vector<float> v0;
         std::vector<float> v1;
         std::vector<float> v2;
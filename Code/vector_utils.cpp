@@ -1,9 +1,10 @@
 #include "vector_utils.h"
+#include <limits>
 
-void normalize(std::vector<float> &vec)
+void normalize(Vec3 &vec)
 {
     float length = sqrt(vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2]);
-    if (length > 1e-6)
+    if (length > 0.0f)
     {
         for (float &v : vec)
         {
@@ -12,24 +13,33 @@ void normalize(std::vector<float> &vec)
     }
 }
 
-std::vector<float> reflect(const std::vector<float> &incident, const std::vector<float> &normal)
+Vec3 reflect(const Vec3 &incident, const Vec3 &normal)
 {
     float dot = incident[0] * normal[0] + incident[1] * normal[1] + incident[2] * normal[2];
-    std::vector<float> reflected = {
+    Vec3 reflected = {
         incident[0] - 2 * dot * normal[0],
         incident[1] - 2 * dot * normal[1],
         incident[2] - 2 * dot * normal[2]};
     return reflected;
 }
 
-std::vector<float> refract(const std::vector<float> &incident, const std::vector<float> &normal, float eta_ratio)
+bool refract(const Vec3 &incident, const Vec3 &normal, float eta_ratio, Vec3 &refracted)
 {
     float cos_theta = -(incident[0] * normal[0] + incident[1] * normal[1] + incident[2] * normal[2]);
     float k = eta_ratio * eta_ratio * (1.0f - cos_theta * cos_theta);
-    if (k < 0.0f) return {};
+    if (k < 0.0f) return false;
     float sqrt_k = sqrt(k);
-    return {
+    refracted = {
         eta_ratio * incident[0] + (eta_ratio * cos_theta - sqrt_k) * normal[0],
         eta_ratio * incident[1] + (eta_ratio * cos_theta - sqrt_k) * normal[1],
         eta_ratio * incident[2] + (eta_ratio * cos_theta - sqrt_k) * normal[2]};
+    return true;
+}
+
+Vec3 offsetOrigin(const Vec3 &point, const Vec3 &normal, float magnitude)
+{
+    float offset = magnitude * (256.0f * std::numeric_limits<float>::epsilon());
+    return {point[0] + offset * normal[0],
+            point[1] + offset * normal[1],
+            point[2] + offset * normal[2]};
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #ifndef VECTOR_UTILS_H
 #define VECTOR_UTILS_H
 
+#include <array>
 #include <vector>
 #include <cmath>
 
+// Fixed-size vector for per-ray points, directions and colors; unlike
+// std::vector<float> it lives on the stack and never allocates.
+typedef std::array<float, 3> Vec3;
+
 // Function to normalize a vector
-void normalize(std::vector<float> &vec);
-std::vector<float> reflect(const std::vector<float> &incident, const std::vector<float> &normal);
-std::vector<float> refract(const std::vector<float> &incident, const std::vector<float> &normal, float eta_ratio);
+void normalize(Vec3 &vec);
+Vec3 reflect(const Vec3 &incident, const Vec3 &normal);
+// Returns false on total internal reflection.
+bool refract(const Vec3 &incident, const Vec3 &normal, float eta_ratio, Vec3 &refracted);
+// Moves a computed surface point off the surface along normal by a bound on
+// its rounding error: 256 ulps of magnitude, the largest value the point was
+// computed from. The offset follows float precision, not the scene's scale.
+Vec3 offsetOrigin(const Vec3 &point, const Vec3 &normal, float magnitude);
 
 #endif
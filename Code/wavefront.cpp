@@ -0,0 +1,400 @@
+#include "wavefront.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "bvh.h"
+#include "blinn_phong_shader.h"
+#include "shadow.h"
+
+// A shaded hit waiting for the colors of its reflection and refraction rays.
+struct WaveNode
+{
+    int parent;
+    int slot;
+    // Blinn-Phong color with shadows applied
+    Vec3 color;
+    // Factor this node's color is scaled by on its way to the pixel
+    float weight;
+    float phong_weight;
+    float reflect_weight;
+    float refract_weight;
+    Vec3 children[2];
+};
+
+struct Wave
+{
+    WaveNode *nodes;
+    size_t count;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RayQueue::allocate(Arena &arena, size_t capacity)
+{
+    for (float **column : {&ox, &oy, &oz, &dx, &dy, &dz})
+    {
+        *column = arena.allocateArray<float>(capacity);
+    }
+    for (int **column : {&exclude_primitive, &exclude_instance, &parent, &slot})
+    {
+        *column = arena.allocateArray<int>(capacity);
+    }
+    count = 0;
+}
+
+void RayQueue::push(const Ray &ray, int parent_node, int target_slot)
+{
+    ox[count] = ray.origin[0];
+    oy[count] = ray.origin[1];
+    oz[count] = ray.origin[2];
+    dx[count] = ray.direction[0];
+    dy[count] = ray.direction[1];
+    dz[count] = ray.direction[2];
+    exclude_primitive[count] = ray.exclude_primitive;
+    exclude_instance[count] = ray.exclude_instance;
+    parent[count] = parent_node;
+    slot[count] = target_slot;
+    ++count;
+}
+
+Ray RayQueue::ray(size_t i) const
+{
+    Ray ray({ox[i], oy[i], oz[i]}, {dx[i], dy[i], dz[i]});
+    ray.exclude_primitive = exclude_primitive[i];
+    ray.exclude_instance = exclude_instance[i];
+    return ray;
+}
+
+WavefrontStats &WavefrontStats::operator+=(const WavefrontStats &other)
+{
+    generate_seconds += other.generate_seconds;
+    intersect_seconds += other.intersect_seconds;
+    shade_seconds += other.shade_seconds;
+    shadow_seconds += other.shadow_seconds;
+    resolve_seconds += other.resolve_seconds;
+    sort_seconds += other.sort_seconds;
+    rays += other.rays;
+    shadow_rays += other.shadow_rays;
+    secondary_rays += other.secondary_rays;
+    sorted_rays += other.sorted_rays;
+    octant_changes_before += other.octant_changes_before;
+    octant_changes_after += other.octant_changes_after;
+    origin_steps_before += other.origin_steps_before;
+    origin_steps_after += other.origin_steps_after;
+    pruned_rays += other.pruned_rays;
+    return *this;
+}
+
+Wavefront::Wavefront(const Scene &scene, const std::vector<Light> &lights, const Vec3 &background, const Vec3 &eye, int max_depth, bool shade, bool sort_secondary, float min_contribution)
+    : scene(scene), lights(lights), background(background), eye(eye), max_depth(max_depth), shade(shade), sort_secondary(sort_secondary), min_contribution(min_contribution) {}
+
+// A secondary wave is sorted when more than one ray in this many changes
+// octant from its predecessor.
+const uint64_t kSortDivisor = 16;
+
+static int octant(const RayQueue &rays, size_t i)
+{
+    return (rays.dx[i] < 0.0f ? 4 : 0) | (rays.dy[i] < 0.0f ? 2 : 0) | (rays.dz[i] < 0.0f ? 1 : 0);
+}
+
+static void measureCoherence(const RayQueue &rays, uint64_t &octant_changes, double &origin_steps)
+{
+    for (size_t i = 1; i < rays.count; ++i)
+    {
+        octant_changes += octant(rays, i) != octant(rays, i - 1);
+        float step[3] = {rays.ox[i] - rays.ox[i - 1], rays.oy[i] - rays.oy[i - 1], rays.oz[i] - rays.oz[i - 1]};
+        origin_steps += std::sqrt(step[0] * step[0] + step[1] * step[1] + step[2] * step[2]);
+    }
+}
+
+// Reorders rays by octant, then by the Morton cell of their origin on an
+// 8x8x8 grid over the queue's bounds. One stable counting pass does it, so
+// rays sharing a bin keep their pixel order.
+static RayQueue sortRays(Arena &arena, const RayQueue &rays)
+{
+    Aabb box;
+    for (size_t i = 0; i < rays.count; ++i)
+    {
+        float origin[3] = {rays.ox[i], rays.oy[i], rays.oz[i]};
+        box.expand(origin);
+    }
+    float scale[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = box.max[axis] - box.min[axis];
+        scale[axis] = extent > 0.0f ? 1.0f / extent : 0.0f;
+    }
+
+    const size_t bin_count = 8 << 9;
+    uint32_t *starts = arena.allocateArray<uint32_t>(bin_count + 1);
+    std::fill(starts, starts + bin_count + 1, 0u);
+    uint16_t *bins = arena.allocateArray<uint16_t>(rays.count);
+    for (size_t i = 0; i < rays.count; ++i)
+    {
+        uint32_t code = mortonCode((rays.ox[i] - box.min[0]) * scale[0],
+                                   (rays.oy[i] - box.min[1]) * scale[1],
+                                   (rays.oz[i] - box.min[2]) * scale[2]);
+        bins[i] = static_cast<uint16_t>(octant(rays, i) << 9 | code >> 21);
+        ++starts[bins[i] + 1];
+    }
+    for (size_t bin = 0; bin < bin_count; ++bin)
+    {
+        starts[bin + 1] += starts[bin];
+    }
+
+    RayQueue sorted;
+    sorted.allocate(arena, rays.count);
+    for (size_t i = 0; i < rays.count; ++i)
+    {
+        uint32_t k = starts[bins[i]]++;
+        sorted.ox[k] = rays.ox[i];
+        sorted.oy[k] = rays.oy[i];
+        sorted.oz[k] = rays.oz[i];
+        sorted.dx[k] = rays.dx[i];
+        sorted.dy[k] = rays.dy[i];
+        sorted.dz[k] = rays.dz[i];
+        sorted.exclude_primitive[k] = rays.exclude_primitive[i];
+        sorted.exclude_instance[k] = rays.exclude_instance[i];
+        sorted.parent[k] = rays.parent[i];
+        sorted.slot[k] = rays.slot[i];
+    }
+    sorted.count = rays.count;
+    return sorted;
+}
+
+void Wavefront::trace(Arena &arena, const RayQueue &primary, Vec3 *colors, WavefrontStats &stats, AovSample *aovs) const
+{
+    if (max_depth < 0)
+    {
+        std::fill(colors, colors + primary.count, background);
+        return;
+    }
+
+    size_t light_count = lights.size();
+    Wave *waves = arena.allocateArray<Wave>(max_depth + 1);
+    int wave_count = 0;
+    auto target = [&](int depth, int parent, int slot) -> Vec3 & {
+        return parent < 0 ? colors[slot] : waves[depth - 1].nodes[parent].children[slot];
+    };
+
+    RayQueue rays = primary;
+    for (int depth = 0; rays.count > 0; ++depth)
+    {
+        size_t count = rays.count;
+        stats.rays += count;
+
+        auto start = std::chrono::steady_clock::now();
+        if (depth > 0)
+        {
+            // Rays spawned in pixel order off smooth surfaces are usually
+            // coherent already; sorting only pays once a good share of
+            // neighbours point into different octants.
+            uint64_t octant_changes = 0;
+            double origin_steps = 0.0;
+            measureCoherence(rays, octant_changes, origin_steps);
+            stats.secondary_rays += count;
+            stats.octant_changes_before += octant_changes;
+            stats.origin_steps_before += origin_steps;
+            if (sort_secondary && octant_changes * kSortDivisor > count)
+            {
+                rays = sortRays(arena, rays);
+                octant_changes = 0;
+                origin_steps = 0.0;
+                measureCoherence(rays, octant_changes, origin_steps);
+                stats.sorted_rays += count;
+            }
+            stats.octant_changes_after += octant_changes;
+            stats.origin_steps_after += origin_steps;
+            stats.sort_seconds += secondsSince(start);
+            start = std::chrono::steady_clock::now();
+        }
+        HitRecord *hits = arena.allocateArray<HitRecord>(count);
+        bool *found = arena.allocateArray<bool>(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            hits[i] = HitRecord();
+            // Binary mode only needs to know whether anything was hit.
+            found[i] = shade ? scene.intersect(rays.ray(i), hits[i]) : scene.occluded(rays.ray(i));
+        }
+        stats.intersect_seconds += secondsSince(start);
+
+        // Misses and binary hits are final. Shaded hits become nodes that
+        // queue one shadow ray per light and their secondary rays; the
+        // shadow rays are indexed node * light_count + light.
+        start = std::chrono::steady_clock::now();
+        Wave &wave = waves[wave_count++];
+        wave.nodes = arena.allocateArray<WaveNode>(count);
+        wave.count = 0;
+        RayQueue shadow_rays;
+        shadow_rays.allocate(arena, shade ? count * light_count : 0);
+        Vec3 *light_terms = arena.allocateArray<Vec3>(shade ? count * light_count : 0);
+        RayQueue next;
+        next.allocate(arena, shade && depth < max_depth ? 2 * count : 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!found[i])
+            {
+                target(depth, rays.parent[i], rays.slot[i]) = background;
+                continue;
+            }
+            if (!shade)
+            {
+                target(depth, rays.parent[i], rays.slot[i]) = {1.0f, 0.0f, 0.0f};
+                continue;
+            }
+
+            Ray ray = rays.ray(i);
+            Vec3 point;
+            Vec3 normal;
+            const Material *material;
+            scene.surfaceAt(ray, hits[i], point, normal, material);
+            if (aovs && rays.parent[i] < 0)
+            {
+                aovs[rays.slot[i]] = AovSample::fromHit(scene, hits[i], normal, *material);
+            }
+
+            int index = static_cast<int>(wave.count++);
+            WaveNode &node = wave.nodes[index];
+            node.parent = rays.parent[i];
+            node.slot = rays.slot[i];
+            node.color = BlinnPhongShader::ambientTerm(*material);
+            node.children[0] = {0.0f, 0.0f, 0.0f};
+            node.children[1] = {0.0f, 0.0f, 0.0f};
+
+            // Mirror and glass kernels give the Blinn-Phong color no weight,
+            // so those nodes skip their shadow rays.
+            bool phong = material->kernel == ShadingKernel::Diffuse || material->kernel == ShadingKernel::Specular || material->kernel == ShadingKernel::Glossy;
+            Vec3 viewDir = {eye[0] - point[0], eye[1] - point[1], eye[2] - point[2]};
+            normalize(viewDir);
+            for (size_t light = 0; light < light_count; ++light)
+            {
+                Vec3 &term = light_terms[index * light_count + light];
+                if (!phong)
+                {
+                    term = {0.0f, 0.0f, 0.0f};
+                    continue;
+                }
+                shadow_rays.push(Shadow::shadowRay(scene, hits[i], point, normal, lights[light]), index, static_cast<int>(light));
+                term = material->kernel == ShadingKernel::Diffuse ? BlinnPhongShader::lightTerm<false>(point, normal, viewDir, *material, lights[light])
+                                                                  : BlinnPhongShader::lightTerm<true>(point, normal, viewDir, *material, lights[light]);
+            }
+
+            float reflectivity = material->is_reflective ? material->reflectivity : 0.0f;
+            float refractionFactor = material->is_refractive ? (1.0f - reflectivity) : 0.0f;
+            node.phong_weight = 1.0f - reflectivity - refractionFactor;
+            node.reflect_weight = reflectivity;
+            node.refract_weight = refractionFactor;
+            node.weight = 1.0f;
+            if (node.parent >= 0)
+            {
+                const WaveNode &parent = waves[depth - 1].nodes[node.parent];
+                node.weight = parent.weight * (node.slot == 0 ? parent.reflect_weight : parent.refract_weight);
+            }
+
+            // Same secondary rays as handleReflection and handleRefraction,
+            // pruned first as traceRay does; past the bounce limit they see
+            // the background.
+            if (material->is_reflective && std::fabs(node.weight * node.reflect_weight) < min_contribution)
+            {
+                ++stats.pruned_rays;
+            }
+            else if (material->is_reflective)
+            {
+                Vec3 direction = reflect(ray.direction, normal);
+                normalize(direction);
+                if (depth < max_depth)
+                {
+                    next.push(scene.spawnRay(hits[i], point, normal, direction), index, 0);
+                }
+                else
+                {
+                    node.children[0] = background;
+                }
+            }
+            if (material->is_refractive && std::fabs(node.weight * node.refract_weight) < min_contribution)
+            {
+                ++stats.pruned_rays;
+            }
+            else if (material->is_refractive)
+            {
+                float cos_theta = -(ray.direction[0] * normal[0] +
+                                    ray.direction[1] * normal[1] +
+                                    ray.direction[2] * normal[2]);
+                Vec3 facing = normal;
+                float eta_ratio = material->refractive_index;
+                if (cos_theta < 0.0f)
+                {
+                    facing = {-normal[0], -normal[1], -normal[2]};
+                    eta_ratio = 1.0f / eta_ratio;
+                }
+                Vec3 direction;
+                if (refract(ray.direction, facing, eta_ratio, direction))
+                {
+                    normalize(direction);
+                    if (depth < max_depth)
+                    {
+                        next.push(scene.spawnRay(hits[i], point, normal, direction), index, 1);
+                    }
+                    else
+                    {
+                        node.children[1] = background;
+                    }
+                }
+            }
+        }
+        stats.shade_seconds += secondsSince(start);
+
+        // Lights are added in scene order, as calculateColor does, so the
+        // sums round identically.
+        start = std::chrono::steady_clock::now();
+        stats.shadow_rays += shadow_rays.count;
+        for (size_t i = 0; i < shadow_rays.count; ++i)
+        {
+            if (scene.occluded(shadow_rays.ray(i)))
+            {
+                light_terms[shadow_rays.parent[i] * light_count + shadow_rays.slot[i]] = {0.0f, 0.0f, 0.0f};
+            }
+        }
+        for (size_t n = 0; n < wave.count; ++n)
+        {
+            Vec3 &color = wave.nodes[n].color;
+            for (size_t light = 0; light < light_count; ++light)
+            {
+                const Vec3 &term = light_terms[n * light_count + light];
+                color[0] += term[0];
+                color[1] += term[1];
+                color[2] += term[2];
+            }
+            color[0] = std::min(color[0], 1.0f);
+            color[1] = std::min(color[1], 1.0f);
+            color[2] = std::min(color[2], 1.0f);
+        }
+        stats.shadow_seconds += secondsSince(start);
+
+        rays = next;
+    }
+
+    // Children live in later waves, so resolving from the deepest wave up
+    // finishes every node's secondary colors before the node itself.
+    auto start = std::chrono::steady_clock::now();
+    for (int depth = wave_count - 1; depth >= 0; --depth)
+    {
+        const Wave &wave = waves[depth];
+        for (size_t n = 0; n < wave.count; ++n)
+        {
+            const WaveNode &node = wave.nodes[n];
+            Vec3 &color = target(depth, node.parent, node.slot);
+            for (int c = 0; c < 3; ++c)
+            {
+                color[c] = node.color[c] * node.phong_weight
+                           + node.children[0][c] * node.reflect_weight
+                           + node.children[1][c] * node.refract_weight;
+                color[c] = std::min(std::max(color[c], 0.0f), 1.0f);
+            }
+        }
+    }
+    stats.resolve_seconds += secondsSince(start);
+}
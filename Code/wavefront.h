@@ -0,0 +1,91 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "aov.h"
+#include "arena.h"
+#include "light.h"
+#include "scene.h"
+#include "vector_utils.h"
+
+// Structure-of-arrays batch of rays with fixed capacity, carved from an arena.
+// Each ray carries where its color goes: slot of node parent in the previous
+// wave, or entry slot of the output when parent is -1.
+struct RayQueue
+{
+    float *ox = nullptr, *oy = nullptr, *oz = nullptr;
+    float *dx = nullptr, *dy = nullptr, *dz = nullptr;
+    int *exclude_primitive = nullptr;
+    int *exclude_instance = nullptr;
+    int *parent = nullptr;
+    int *slot = nullptr;
+    size_t count = 0;
+
+    void allocate(Arena &arena, size_t capacity);
+    // Keeps origin, direction and exclusion; the t interval is always the full one.
+    void push(const Ray &ray, int parent_node, int target_slot);
+    Ray ray(size_t i) const;
+};
+
+// Time spent in each stage, summed over threads, and the rays they handled.
+struct WavefrontStats
+{
+    double generate_seconds = 0.0;
+    double intersect_seconds = 0.0;
+    double shade_seconds = 0.0;
+    double shadow_seconds = 0.0;
+    double resolve_seconds = 0.0;
+    double sort_seconds = 0.0;
+    uint64_t rays = 0;
+    uint64_t shadow_rays = 0;
+    // Secondary ray coherence: adjacent rays in queue order that point into
+    // different octants, and their summed origin distance, before and after
+    // sorting.
+    uint64_t secondary_rays = 0;
+    uint64_t sorted_rays = 0;
+    uint64_t octant_changes_before = 0;
+    uint64_t octant_changes_after = 0;
+    double origin_steps_before = 0.0;
+    double origin_steps_after = 0.0;
+    // Secondary rays left out for contributing less than min_contribution.
+    uint64_t pruned_rays = 0;
+
+    WavefrontStats &operator+=(const WavefrontStats &other);
+};
+
+// Breadth-first alternative to Tools::traceRay. A batch of camera rays is
+// traced one bounce at a time: every ray of a wave is intersected, then every
+// hit is shaded, which queues its shadow rays and the next wave's reflection
+// and refraction rays. Once no rays remain, the hit records are folded back
+// into colors from the deepest wave up. Results match traceRay exactly.
+//
+// Reflection and refraction rays can point every which way. With
+// sort_secondary, a wave after the first whose rays often switch direction
+// octant is ordered by octant and then by the Morton code of its origin
+// before tracing, so that neighbouring rays walk the same BVH nodes.
+class Wavefront
+{
+public:
+    // With shade false this reproduces the binary render mode.
+    // min_contribution prunes secondary rays as Tools::setMinContribution does.
+    Wavefront(const Scene &scene, const std::vector<Light> &lights, const Vec3 &background, const Vec3 &eye, int max_depth, bool shade, bool sort_secondary = true, float min_contribution = 0.0f);
+
+    // colors[i] receives the color of primary ray i, and aovs[i], if given,
+    // its first hit. All scratch memory comes from arena; callers rewind it
+    // afterwards.
+    void trace(Arena &arena, const RayQueue &primary, Vec3 *colors, WavefrontStats &stats, AovSample *aovs = nullptr) const;
+
+private:
+    const Scene &scene;
+    const std::vector<Light> &lights;
+    Vec3 background;
+    Vec3 eye;
+    int max_depth;
+    bool shade;
+    bool sort_secondary;
+    float min_contribution;
+};
+
+#endif